@@ -0,0 +1,72 @@
+#include "AssetPack.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace VaryZulu::Assets
+{
+namespace
+{
+std::string_view getName(const PackEntry& entry)
+{
+    return {entry.name.data(), strnlen(entry.name.data(), entry.name.size())};
+}
+} // namespace
+
+AssetPack::AssetPack(const std::string& path) : file(path)
+{
+    auto data = file.getData();
+    PackHeader header;
+    if (data.size() < sizeof(header)) {
+        throw std::runtime_error("Asset pack is truncated");
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != PACK_MAGIC) {
+        throw std::runtime_error("Not an asset pack");
+    }
+    if (header.version != PACK_VERSION || header.entrySize != sizeof(PackEntry)) {
+        spdlog::error("Asset pack {} has version {}, expected {}. Rebake it", path,
+            header.version, PACK_VERSION);
+        throw std::runtime_error("Asset pack version mismatch");
+    }
+    if (header.tocOffset % alignof(PackEntry) != 0 || header.tocOffset > data.size() ||
+        (data.size() - header.tocOffset) / sizeof(PackEntry) < header.entryCount) {
+        throw std::runtime_error("Asset pack is truncated");
+    }
+    // File data is aligned for any scalar type and the offset was checked above, so the
+    // entries can be used where they are
+    entries = {reinterpret_cast<const PackEntry*>(data.data() + header.tocOffset),
+        header.entryCount};
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& entry = entries[i];
+        if (entry.offset % PACK_ALIGNMENT != 0 || entry.offset > data.size() ||
+            data.size() - entry.offset < entry.size) {
+            throw std::runtime_error("Asset pack is truncated");
+        }
+        if (i > 0 && getName(entries[i - 1]) >= getName(entry)) {
+            throw std::runtime_error("Asset pack table of contents is not sorted");
+        }
+    }
+    spdlog::info("Mapped asset pack {}: {} assets, {} KiB", path, entries.size(),
+        data.size() / 1024);
+}
+
+const PackEntry* AssetPack::find(std::string_view name, AssetType type) const
+{
+    auto found = std::lower_bound(entries.begin(), entries.end(), name,
+        [](const PackEntry& entry, std::string_view key) { return getName(entry) < key; });
+    if (found == entries.end() || getName(*found) != name || found->type != type) {
+        return nullptr;
+    }
+    return &*found;
+}
+
+std::span<const std::byte> AssetPack::getData(const PackEntry& entry) const
+{
+    return file.getData().subspan(entry.offset, entry.size);
+}
+
+} // namespace VaryZulu::Assets
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "PackFormat.h"
+#include "Utils/MappedFile.h"
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace VaryZulu::Assets
+{
+// Baked assets mapped straight from disk. Opening checks the header and that every entry lies
+// inside the file, nothing is parsed or copied; asset bytes are read by the OS on first access
+class AssetPack
+{
+public:
+    // Throws if the file is missing, truncated or was baked for another pack version
+    explicit AssetPack(const std::string& path);
+
+    // Binary search over the sorted table of contents. Null if there is no such asset
+    const PackEntry* find(std::string_view name, AssetType type) const;
+    std::span<const std::byte> getData(const PackEntry& entry) const;
+
+    std::span<const PackEntry> getEntries() const
+    {
+        return entries;
+    }
+
+private:
+    Utils::MappedFile file;
+    std::span<const PackEntry> entries;
+};
+
+} // namespace VaryZulu::Assets
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Layout of an asset pack, shared by the baker in tools/ and the runtime reader. Everything is
+// little endian and fixed size, so the reader uses the table of contents in place:
+//
+//   PackHeader | PackEntry[entryCount], sorted by name | asset data, each PACK_ALIGNMENT aligned
+//
+// Asset data is stored exactly as it is uploaded:
+//   Texture: every mip level packed back to back, largest first, in the entry's VkFormat
+//   Mesh: vertexCount Gfx::Vertex followed by indexCount uint32_t indices
+//   Shader: SPIR-V words
+namespace VaryZulu::Assets
+{
+// "VZPK"
+constexpr uint32_t PACK_MAGIC = 0x4B505A56;
+// Bump whenever the layout of the header, the entries or any asset data changes
+constexpr uint32_t PACK_VERSION = 1;
+// Keeps every asset aligned for any element type and for compressed texel blocks
+constexpr uint64_t PACK_ALIGNMENT = 256;
+constexpr size_t PACK_MAX_NAME = 56;
+
+enum class AssetType : uint32_t
+{
+    Texture = 1,
+    Mesh = 2,
+    Shader = 3,
+};
+
+struct PackHeader
+{
+    uint32_t magic = PACK_MAGIC;
+    uint32_t version = PACK_VERSION;
+    uint32_t entryCount = 0;
+    uint32_t entrySize = 0;
+    uint64_t tocOffset = 0;
+    uint64_t reserved = 0;
+};
+
+struct PackEntry
+{
+    // Path the asset would be loaded from without a pack, nul terminated
+    std::array<char, PACK_MAX_NAME> name{};
+    AssetType type = AssetType::Texture;
+    uint32_t reserved = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    // Texture: VkFormat, width, height, mip levels
+    // Mesh: vertex count, index count, sizeof(Gfx::Vertex)
+    std::array<uint32_t, 4> info{};
+};
+
+static_assert(sizeof(PackHeader) == 32 && std::is_trivially_copyable_v<PackHeader>);
+static_assert(sizeof(PackEntry) == 96 && std::is_trivially_copyable_v<PackEntry>);
+
+} // namespace VaryZulu::Assets
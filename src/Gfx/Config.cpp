@@ -0,0 +1,212 @@
+#include "Config.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+// A decimal number up to max, nothing else. std::stoull alone would skip leading whitespace,
+// wrap negative numbers around and ignore trailing characters
+uint64_t parseNumber(const std::string& option, const char* value, uint64_t max)
+{
+    if (!value) {
+        spdlog::error("Missing value for {}", option);
+        throw std::runtime_error("Missing command line value");
+    }
+    size_t pos = 0;
+    uint64_t number = 0;
+    if (std::isdigit(static_cast<unsigned char>(value[0]))) {
+        try {
+            number = std::stoull(value, &pos);
+        } catch (const std::exception&) {
+            pos = 0;
+        }
+    }
+    if (pos == 0 || pos != std::strlen(value) || number > max) {
+        spdlog::error("Invalid value for {}: {}, expected a number up to {}", option, value, max);
+        throw std::runtime_error("Invalid command line value");
+    }
+    return number;
+}
+
+uint32_t parseUint32(const std::string& option, const char* value)
+{
+    return static_cast<uint32_t>(
+        parseNumber(option, value, std::numeric_limits<uint32_t>::max()));
+}
+
+std::optional<std::string> getEnv(const char* name)
+{
+#ifdef WIN32
+    char* buf = nullptr;
+    size_t size = 0;
+    if (_dupenv_s(&buf, &size, name) != 0 || !buf) {
+        return std::nullopt;
+    }
+    std::string value{buf};
+    free(buf);
+    return value;
+#else
+    const char* value = std::getenv(name);
+    if (!value) {
+        return std::nullopt;
+    }
+    return std::string{value};
+#endif
+}
+
+PresentPolicy parsePresentPolicy(const std::string& option, const char* value)
+{
+    if (!value) {
+        spdlog::error("Missing value for {}", option);
+        throw std::runtime_error("Missing command line value");
+    }
+    for (auto policy :
+        {PresentPolicy::LowLatency, PresentPolicy::PowerSaving, PresentPolicy::Throughput}) {
+        if (std::string{value} == getPresentPolicyName(policy)) {
+            return policy;
+        }
+    }
+    spdlog::error("Invalid value for {}: {}, expected low-latency, power-saving or throughput",
+        option, value);
+    throw std::runtime_error("Invalid command line value");
+}
+} // namespace
+
+const char* getPresentPolicyName(PresentPolicy policy)
+{
+    switch (policy) {
+        case PresentPolicy::LowLatency:
+            return "low-latency";
+        case PresentPolicy::PowerSaving:
+            return "power-saving";
+        case PresentPolicy::Throughput:
+            return "throughput";
+    }
+    return "unknown";
+}
+
+Config parseCommandLine(int argc, char** argv)
+{
+    Config config;
+    if (auto envDevice = getEnv("VZ_DEVICE_INDEX"); envDevice && !envDevice->empty()) {
+        config.deviceIndex = parseUint32("VZ_DEVICE_INDEX", envDevice->c_str());
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        const char* next = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--pipeline-cache") {
+            if (!next) {
+                spdlog::error("Missing value for {}", arg);
+                throw std::runtime_error("Missing command line value");
+            }
+            config.pipelineCachePath = next;
+            ++i;
+        } else if (arg == "--profile-trace") {
+            if (!next) {
+                spdlog::error("Missing value for {}", arg);
+                throw std::runtime_error("Missing command line value");
+            }
+            config.profileTracePath = next;
+            ++i;
+        } else if (arg == "--asset-pack") {
+            if (!next) {
+                spdlog::error("Missing value for {}", arg);
+                throw std::runtime_error("Missing command line value");
+            }
+            config.assetPackPath = next;
+            ++i;
+        } else if (arg == "--texture") {
+            if (!next) {
+                spdlog::error("Missing value for {}", arg);
+                throw std::runtime_error("Missing command line value");
+            }
+            config.texturePath = next;
+            ++i;
+        } else if (arg == "--trace") {
+            if (!next) {
+                spdlog::error("Missing value for {}", arg);
+                throw std::runtime_error("Missing command line value");
+            }
+            config.tracePath = next;
+            ++i;
+        } else if (arg == "--shader-dir") {
+            if (!next) {
+                spdlog::error("Missing value for {}", arg);
+                throw std::runtime_error("Missing command line value");
+            }
+            config.shaderSourceDir = next;
+            ++i;
+        } else if (arg == "--watch-shaders") {
+            config.watchShaders = true;
+        } else if (arg == "--bench-startup") {
+            config.benchStartup = true;
+        } else if (arg == "--bench-mips") {
+            config.benchMips = true;
+        } else if (arg == "--bench-instances") {
+            config.benchInstances = true;
+        } else if (arg == "--bench-present") {
+            config.benchPresent = true;
+        } else if (arg == "--present-policy") {
+            config.presentPolicy = parsePresentPolicy(arg, next);
+            ++i;
+        } else if (arg == "--depth-prepass") {
+            config.depthPrepass = true;
+        } else if (arg == "--no-gpu-cull") {
+            config.gpuCulling = false;
+        } else if (arg == "--frames") {
+            config.frameLimit = parseNumber(arg, next, std::numeric_limits<uint64_t>::max());
+            ++i;
+        } else if (arg == "--device") {
+            config.deviceIndex = parseUint32(arg, next);
+            ++i;
+        } else if (arg == "--record-threads") {
+            config.recordThreads = parseUint32(arg, next);
+            ++i;
+        } else if (arg == "--frames-in-flight") {
+            config.framesInFlight = parseUint32(arg, next);
+            ++i;
+        } else if (arg == "--latency-limit") {
+            config.latencyLimit = parseUint32(arg, next);
+            ++i;
+        } else if (arg == "--frame-rate-cap") {
+            config.frameRateCap = parseUint32(arg, next);
+            ++i;
+        } else if (arg == "--instances") {
+            config.instanceCount = parseUint32(arg, next);
+            ++i;
+        } else if (arg == "--width") {
+            config.width = parseUint32(arg, next);
+            ++i;
+        } else if (arg == "--height") {
+            config.height = parseUint32(arg, next);
+            ++i;
+        } else {
+            spdlog::error("Unknown option: {}", arg);
+            throw std::runtime_error("Unknown command line option");
+        }
+    }
+    if (config.width == 0 || config.height == 0) {
+        throw std::runtime_error("Render target size must be positive");
+    }
+    if (config.instanceCount == 0) {
+        throw std::runtime_error("Instance count must be positive");
+    }
+    if (config.headless && config.frameLimit == 0 && !config.benchInstances &&
+        !config.benchMips && !config.benchPresent) {
+        config.frameLimit = 1000;
+    }
+    return config;
+}
+
+} // namespace VaryZulu::Gfx
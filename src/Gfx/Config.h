@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Set by CMake to the source tree's shader directory
+#ifndef VZ_SHADER_SOURCE_DIR
+#define VZ_SHADER_SOURCE_DIR "../shaders"
+#endif
+
+namespace VaryZulu::Gfx
+{
+// Trades input latency against power and frame rate. Explicit --latency-limit and
+// --frame-rate-cap settings override what a policy picks
+enum class PresentPolicy
+{
+    // IMMEDIATE or MAILBOX with the fewest images, a frame begins once the GPU is idle
+    LowLatency,
+    // FIFO, capped at POWER_SAVING_FRAME_RATE unless --frame-rate-cap is given
+    PowerSaving,
+    // MAILBOX if available, with an image for every frame in flight on top of the minimum
+    Throughput,
+};
+
+constexpr uint32_t POWER_SAVING_FRAME_RATE = 30;
+
+// The name --present-policy takes
+const char* getPresentPolicyName(PresentPolicy policy);
+
+struct Config
+{
+    // Render into offscreen images without a window, surface or swapchain
+    bool headless = false;
+    uint32_t width = 800;
+    uint32_t height = 600;
+    // Stop after this many frames. 0 means run until the window is closed
+    uint64_t frameLimit = 0;
+    // Force a physical device by enumeration index instead of picking the best scored one.
+    // Set with --device or the VZ_DEVICE_INDEX environment variable
+    std::optional<uint32_t> deviceIndex;
+    // Threads recording secondary command buffers. 0 picks one per spare core
+    uint32_t recordThreads = 0;
+    // Image on every object. KTX2 and DDS files with BC1, BC3 or BC7 data are uploaded as is
+    std::string texturePath = "textures/texture.jpg";
+    // Baked assets, see tools/AssetBaker. Anything not in the pack is loaded from its file
+    std::string assetPackPath;
+    // Lay down depth in a pass of its own first, so the main pass shades each pixel only once
+    bool depthPrepass = false;
+    // Frames the CPU may record while the GPU works on earlier ones, up to 4
+    uint32_t framesInFlight = 2;
+    // Frames that may be unfinished when the next one starts, which bounds input latency.
+    // 1 starts a frame only once the GPU is idle. 0 leaves it to the present policy
+    uint32_t latencyLimit = 0;
+    PresentPolicy presentPolicy = PresentPolicy::Throughput;
+    // Frames begun per second at most. 0 leaves it to the present policy
+    uint32_t frameRateCap = 0;
+    // Objects in the demo grid
+    uint32_t instanceCount = 1;
+    // Cull instances in a compute shader when the device can draw the result indirectly
+    bool gpuCulling = true;
+    // Sweep instance counts and report the frame time of each instead of running normally.
+    // --frames sets the measured frames per step
+    bool benchInstances = false;
+    // Relative to the working directory. Empty keeps the pipeline cache in memory only
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    // Compare pipeline creation with a cold and a warm pipeline cache, then exit
+    bool benchStartup = false;
+    // Compare GPU frame times sampling only the base texture level and the full mip chain,
+    // then exit. --frames sets the measured frames per mode
+    bool benchMips = false;
+    // Render with every present policy and report frame times and latency, then exit.
+    // --frames sets the measured frames per policy
+    bool benchPresent = false;
+    // Chrome trace of the last frames, written at exit. Empty disables the dump
+    std::string profileTracePath;
+    // Trace of CPU scopes on all threads, needs a build with ENABLE_TRACING
+    std::string tracePath;
+    // Recompile shaders from shaderSourceDir when they change and swap in the new pipeline.
+    // Shaders are then always loaded from their files, never from the asset pack
+    bool watchShaders = false;
+    std::string shaderSourceDir = VZ_SHADER_SOURCE_DIR;
+};
+
+Config parseCommandLine(int argc, char** argv);
+
+} // namespace VaryZulu::Gfx
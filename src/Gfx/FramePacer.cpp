@@ -0,0 +1,170 @@
+#include "FramePacer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <thread>
+
+namespace VaryZulu::Gfx
+{
+void FramePacer::init(VkDevice vkDevice, uint32_t frameCount, uint32_t limit)
+{
+    device = vkDevice;
+    framesInFlight = std::max(frameCount, 1u);
+    setLatencyLimit(limit);
+    beginTimes.assign(framesInFlight, Clock::now());
+    completedFrames = 0;
+
+    waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+        vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR"));
+    getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+        vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR"));
+    if (!waitSemaphores || !getSemaphoreCounterValue) {
+        throw std::runtime_error("VK_KHR_timeline_semaphore is not enabled");
+    }
+    VkSemaphoreTypeCreateInfoKHR typeInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+        .initialValue = 0};
+    VkSemaphoreCreateInfo createInfo{
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &typeInfo};
+    if (vkCreateSemaphore(device, &createInfo, nullptr, &timeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timeline semaphore");
+    }
+}
+
+void FramePacer::destroy()
+{
+    vkDestroySemaphore(device, timeline, nullptr);
+    timeline = nullptr;
+}
+
+void FramePacer::setLatencyLimit(uint32_t limit)
+{
+    latencyLimit = limit == 0 ? framesInFlight : std::min(limit, framesInFlight);
+}
+
+void FramePacer::setFrameRateCap(uint32_t framesPerSecond)
+{
+    frameInterval = framesPerSecond == 0
+        ? Clock::duration{}
+        : std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / framesPerSecond;
+    nextBegin = Clock::now();
+}
+
+uint32_t FramePacer::beginFrame(uint64_t frameNumber)
+{
+    // Frames up to frameNumber - latencyLimit have to be finished
+    auto start = Clock::now();
+    if (frameInterval.count() > 0) {
+        // Before the frame begins, so the cap doesn't count as latency
+        std::this_thread::sleep_until(nextBegin);
+    }
+    if (frameNumber >= latencyLimit) {
+        waitFor(frameNumber - latencyLimit + 1);
+    }
+    poll();
+    auto now = Clock::now();
+    if (frameInterval.count() > 0) {
+        // Oversleeping is made up by the next frame, falling further behind isn't
+        nextBegin = std::max(nextBegin + frameInterval, now);
+    }
+    waitMsTotal += std::chrono::duration<double, std::milli>(now - start).count();
+    queuedFramesTotal += frameNumber - completedFrames;
+    ++statBegins;
+
+    auto slot = static_cast<uint32_t>(frameNumber % framesInFlight);
+    beginTimes[slot] = now;
+    return slot;
+}
+
+VkResult FramePacer::submit(VkQueue queue, VkCommandBuffer commandBuffer, uint64_t frameNumber,
+    VkSemaphore waitSemaphore, VkPipelineStageFlags waitStages, VkSemaphore signalSemaphore)
+{
+    // Timeline values of binary semaphores are ignored
+    std::array signalSemaphores{timeline, signalSemaphore};
+    std::array<uint64_t, 2> signalValues{frameNumber + 1, 0};
+    auto signalCount = signalSemaphore ? 2u : 1u;
+    uint64_t waitValue = 0;
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo{
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+        .waitSemaphoreValueCount = waitSemaphore ? 1u : 0u,
+        .pWaitSemaphoreValues = &waitValue,
+        .signalSemaphoreValueCount = signalCount,
+        .pSignalSemaphoreValues = signalValues.data()};
+    VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineInfo,
+        .waitSemaphoreCount = waitSemaphore ? 1u : 0u,
+        .pWaitSemaphores = &waitSemaphore,
+        .pWaitDstStageMask = &waitStages,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+        .signalSemaphoreCount = signalCount,
+        .pSignalSemaphores = signalSemaphores.data()};
+    return vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+}
+
+void FramePacer::poll()
+{
+    uint64_t value = 0;
+    if (getSemaphoreCounterValue(device, timeline, &value) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to read the frame timeline");
+    }
+    auto now = Clock::now();
+    // A finished frame's slot is only reused by a later beginFrame(), after this poll
+    for (auto frame = completedFrames; frame < value; ++frame) {
+        auto latency = std::chrono::duration<double, std::milli>(
+            now - beginTimes[frame % framesInFlight]).count();
+        latencyMsTotal += latency;
+        latencyMsMax = std::max(latencyMsMax, latency);
+        ++statFrames;
+    }
+    completedFrames = std::max(completedFrames, value);
+}
+
+void FramePacer::waitFor(uint64_t value)
+{
+    if (completedFrames >= value) {
+        return;
+    }
+    VkSemaphoreWaitInfoKHR waitInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+        .semaphoreCount = 1,
+        .pSemaphores = &timeline,
+        .pValues = &value};
+    while (true) {
+        auto res = waitSemaphores(device, &waitInfo, WAIT_TIMEOUT_NS);
+        if (res == VK_SUCCESS) {
+            return;
+        }
+        if (res != VK_TIMEOUT) {
+            spdlog::error("Waiting for frame {} failed: {}", value - 1, res);
+            throw std::runtime_error("Failed waiting for a frame");
+        }
+        spdlog::warn("Frame {} not finished after {} ms, still waiting", value - 1,
+            WAIT_TIMEOUT_NS / 1'000'000);
+    }
+}
+
+FramePacingStats FramePacer::takeStats()
+{
+    FramePacingStats stats{.frames = statFrames};
+    if (statBegins > 0) {
+        stats.waitMsAvg = waitMsTotal / static_cast<double>(statBegins);
+        stats.queuedFramesAvg =
+            static_cast<double>(queuedFramesTotal) / static_cast<double>(statBegins);
+    }
+    if (statFrames > 0) {
+        stats.latencyMsAvg = latencyMsTotal / static_cast<double>(statFrames);
+        stats.latencyMsMax = latencyMsMax;
+    }
+    statFrames = 0;
+    statBegins = 0;
+    waitMsTotal = 0.0;
+    latencyMsTotal = 0.0;
+    latencyMsMax = 0.0;
+    queuedFramesTotal = 0;
+    return stats;
+}
+
+} // namespace VaryZulu::Gfx
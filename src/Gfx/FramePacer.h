@@ -0,0 +1,98 @@
+#pragma once
+
+#include "vk_wrap.h"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Pacing of the frames since the last takeStats()
+struct FramePacingStats
+{
+    uint64_t frames = 0;
+    // CPU time blocked in beginFrame()
+    double waitMsAvg = 0.0;
+    // From beginFrame() returning until the frame was seen finished. Completion is noticed by
+    // the next beginFrame() or poll(), so this is an upper bound, off by at most a frame
+    double latencyMsAvg = 0.0;
+    double latencyMsMax = 0.0;
+    // Frames submitted but not finished when a frame began, after the wait
+    double queuedFramesAvg = 0.0;
+};
+
+// Paces frames on one VK_KHR_timeline_semaphore. Submitting frame n signals value n + 1, so the
+// counter is the number of finished frames. Frame n reuses the slot of frame n - framesInFlight
+// and may only begin once at most latencyLimit - 1 frames before it are unfinished. A limit of
+// framesInFlight is what reusing the slot needs, lower limits give up CPU and GPU overlap for
+// less input latency, down to 1 where a frame starts only once the GPU is idle.
+class FramePacer
+{
+public:
+    // timelineSemaphore has to be enabled on device. A latencyLimit of 0 or above
+    // framesInFlight means framesInFlight
+    void init(VkDevice device, uint32_t framesInFlight, uint32_t latencyLimit);
+    void destroy();
+
+    // Blocks until frame frameNumber may be recorded and returns its slot
+    uint32_t beginFrame(uint64_t frameNumber);
+    // Submits frame frameNumber and signals its value once the commands finished. The binary
+    // semaphores are for the swapchain and may be null
+    VkResult submit(VkQueue queue, VkCommandBuffer commandBuffer, uint64_t frameNumber,
+        VkSemaphore waitSemaphore, VkPipelineStageFlags waitStages, VkSemaphore signalSemaphore);
+    // Notices finished frames without blocking
+    void poll();
+
+    // Frames known to be finished, all those numbered below the returned value
+    uint64_t getCompletedFrames() const
+    {
+        return completedFrames;
+    }
+
+    uint32_t getFramesInFlight() const
+    {
+        return framesInFlight;
+    }
+
+    uint32_t getLatencyLimit() const
+    {
+        return latencyLimit;
+    }
+
+    // Takes effect with the next beginFrame()
+    void setLatencyLimit(uint32_t limit);
+    // beginFrame() returns at most this many times a second, 0 disables the cap
+    void setFrameRateCap(uint32_t framesPerSecond);
+
+    FramePacingStats takeStats();
+
+private:
+    // A wait this long is reported, then waited on again
+    static constexpr uint64_t WAIT_TIMEOUT_NS = 1'000'000'000;
+
+    using Clock = std::chrono::steady_clock;
+
+    void waitFor(uint64_t value);
+
+    VkDevice device = nullptr;
+    VkSemaphore timeline = nullptr;
+    PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
+    uint32_t framesInFlight = 1;
+    uint32_t latencyLimit = 1;
+    uint64_t completedFrames = 0;
+    Clock::duration frameInterval{};
+    Clock::time_point nextBegin{};
+    // beginFrame() time of each frame in flight, by slot
+    std::vector<Clock::time_point> beginTimes;
+
+    uint64_t statFrames = 0;
+    uint64_t statBegins = 0;
+    double waitMsTotal = 0.0;
+    double latencyMsTotal = 0.0;
+    double latencyMsMax = 0.0;
+    uint64_t queuedFramesTotal = 0;
+};
+
+} // namespace VaryZulu::Gfx
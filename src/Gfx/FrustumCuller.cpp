@@ -0,0 +1,237 @@
+#include "FrustumCuller.h"
+#include "Utils/Utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+void FrustumCuller::init(VkDevice logicalDevice, MemoryAllocator& allocator,
+    VkPipelineCache pipelineCache, const std::vector<VkBuffer>& instanceBuffers,
+    uint32_t maxInstances, uint32_t maxBatches, bool compactCommands)
+{
+    device = logicalDevice;
+    compact = compactCommands;
+    constexpr VkMemoryPropertyFlags hostVisible =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    frames.resize(instanceBuffers.size());
+    for (auto& frame : frames) {
+        allocator.createBuffer(sizeof(uint32_t) * maxInstances, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            hostVisible, frame.instanceBatches, frame.instanceBatchesMemory);
+        allocator.createBuffer(sizeof(CullBatch) * maxBatches, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            hostVisible, frame.batches, frame.batchesMemory);
+        allocator.createBuffer(sizeof(InstanceData) * maxInstances,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.culledInstances,
+            frame.culledInstancesMemory);
+        allocator.createBuffer(sizeof(VkDrawIndexedIndirectCommand) * maxBatches,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.drawCommands, frame.drawCommandsMemory);
+        // Draw count followed by the visible instance count of every batch
+        allocator.createBuffer(sizeof(uint32_t) * (maxBatches + 1),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.counters, frame.countersMemory);
+    }
+    createDescriptors(instanceBuffers);
+    createPipelines(pipelineCache);
+    spdlog::info("GPU frustum culling enabled, {} draw commands",
+        compact ? "compacted" : "fixed slot");
+}
+
+void FrustumCuller::destroy(MemoryAllocator& allocator)
+{
+    for (auto pipeline : pipelines) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    for (auto& frame : frames) {
+        allocator.destroyBuffer(frame.counters, frame.countersMemory);
+        allocator.destroyBuffer(frame.drawCommands, frame.drawCommandsMemory);
+        allocator.destroyBuffer(frame.culledInstances, frame.culledInstancesMemory);
+        allocator.destroyBuffer(frame.batches, frame.batchesMemory);
+        allocator.destroyBuffer(frame.instanceBatches, frame.instanceBatchesMemory);
+    }
+    frames.clear();
+}
+
+uint32_t* FrustumCuller::getInstanceBatches(uint32_t frame) const
+{
+    return static_cast<uint32_t*>(frames[frame].instanceBatchesMemory.mapped);
+}
+
+CullBatch* FrustumCuller::getBatches(uint32_t frame) const
+{
+    return static_cast<CullBatch*>(frames[frame].batchesMemory.mapped);
+}
+
+void FrustumCuller::createDescriptors(const std::vector<VkBuffer>& instanceBuffers)
+{
+    std::array<VkDescriptorSetLayoutBinding, 6> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i] = VkDescriptorSetLayoutBinding{.binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings = bindings.data()};
+    auto res = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling descriptor set layout");
+    }
+
+    auto frameCount = static_cast<uint32_t>(frames.size());
+    VkDescriptorPoolSize poolSize{.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = frameCount * static_cast<uint32_t>(bindings.size())};
+    VkDescriptorPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = frameCount,
+        .poolSizeCount = 1,
+        .pPoolSizes = &poolSize};
+    res = vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling descriptor pool");
+    }
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+        auto& frame = frames[i];
+        VkDescriptorSetAllocateInfo allocInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = descriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &descriptorSetLayout};
+        res = vkAllocateDescriptorSets(device, &allocInfo, &frame.descriptorSet);
+        if (res != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate culling descriptor set");
+        }
+
+        // In binding order, see cull.comp
+        std::array buffers{instanceBuffers[i], frame.instanceBatches, frame.batches,
+            frame.culledInstances, frame.drawCommands, frame.counters};
+        std::array<VkDescriptorBufferInfo, 6> bufferInfos{};
+        std::array<VkWriteDescriptorSet, 6> writes{};
+        for (uint32_t binding = 0; binding < buffers.size(); ++binding) {
+            bufferInfos[binding] = VkDescriptorBufferInfo{
+                .buffer = buffers[binding], .offset = 0, .range = VK_WHOLE_SIZE};
+            writes[binding] = VkWriteDescriptorSet{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = frame.descriptorSet,
+                .dstBinding = binding,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &bufferInfos[binding]};
+        }
+        vkUpdateDescriptorSets(
+            device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void FrustumCuller::createPipelines(VkPipelineCache pipelineCache)
+{
+    VkPushConstantRange pushConstantRange{
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(CullParams)};
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange};
+    auto res = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling pipeline layout");
+    }
+
+    auto file = Utils::readFile("shaders/cull.comp.spv");
+    auto code = file.getData();
+    VkShaderModuleCreateInfo moduleInfo{.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = code.size(),
+        .pCode = reinterpret_cast<const uint32_t*>(code.data())};
+    VkShaderModule module = nullptr;
+    res = vkCreateShaderModule(device, &moduleInfo, nullptr, &module);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create the culling shader module");
+    }
+
+    VkSpecializationMapEntry passEntry{.constantID = 0, .offset = 0, .size = sizeof(uint32_t)};
+    for (uint32_t pass = 0; pass < pipelines.size(); ++pass) {
+        VkSpecializationInfo specialization{.mapEntryCount = 1,
+            .pMapEntries = &passEntry,
+            .dataSize = sizeof(pass),
+            .pData = &pass};
+        VkComputePipelineCreateInfo pipelineInfo{
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = VkPipelineShaderStageCreateInfo{
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = module,
+                .pName = "main",
+                .pSpecializationInfo = &specialization},
+            .layout = pipelineLayout,
+            .basePipelineHandle = VK_NULL_HANDLE,
+            .basePipelineIndex = -1};
+        res = vkCreateComputePipelines(
+            device, pipelineCache, 1, &pipelineInfo, nullptr, &pipelines[pass]);
+        if (res != VK_SUCCESS) {
+            vkDestroyShaderModule(device, module, nullptr);
+            throw std::runtime_error("Failed to create culling pipeline");
+        }
+    }
+    vkDestroyShaderModule(device, module, nullptr);
+}
+
+void FrustumCuller::record(VkCommandBuffer commandBuffer, uint32_t frame,
+    const glm::mat4& viewProj, uint32_t instanceCount, uint32_t batchCount)
+{
+    const auto& buffers = frames[frame];
+    vkCmdFillBuffer(commandBuffer, buffers.counters, 0, VK_WHOLE_SIZE, 0);
+    VkMemoryBarrier clearBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+    CullParams params{.frustumPlanes = extractFrustumPlanes(viewProj),
+        .instanceCount = instanceCount,
+        .batchCount = batchCount,
+        .compact = compact ? 1u : 0u};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+        &buffers.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+        sizeof(params), &params);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0]);
+    vkCmdDispatch(commandBuffer, (instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    // Command generation reads the final per-batch counts
+    VkMemoryBarrier countBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &countBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[1]);
+    vkCmdDispatch(commandBuffer, (batchCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+}
+
+std::array<glm::vec4, 6> FrustumCuller::extractFrustumPlanes(const glm::mat4& viewProj)
+{
+    // Gribb-Hartmann: planes are sums and differences of the matrix rows. glm is column major
+    auto row = [&](int i) {
+        return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+    };
+    // Projections use Vulkan's 0..1 depth range, so the near plane is the third row alone
+    std::array planes{row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1),
+        row(2), row(3) - row(2)};
+    for (auto& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+#include "Scene.h"
+
+#include "vk_wrap.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Per-batch input of the culling shader
+struct CullBatch
+{
+    uint32_t indexCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    uint32_t firstInstance = 0;
+    // Object space bounding sphere of the batch's mesh
+    alignas(16) glm::vec4 boundingSphere{0.0f};
+};
+
+// Tests instance bounding spheres against the view frustum in a compute shader. Visible
+// instances are copied into a per-frame instance vertex buffer, grouped by batch, and one
+// indirect draw command is written per batch. When compacting, commands of empty batches are
+// dropped and the number of commands is written to the start of the counter buffer for
+// vkCmdDrawIndexedIndirectCount. Otherwise every batch keeps its command slot.
+class FrustumCuller
+{
+public:
+    // instanceBuffers holds the per-frame instance data the CPU writes in batch order
+    void init(VkDevice device, MemoryAllocator& allocator, VkPipelineCache pipelineCache,
+        const std::vector<VkBuffer>& instanceBuffers, uint32_t maxInstances, uint32_t maxBatches,
+        bool compact);
+    void destroy(MemoryAllocator& allocator);
+
+    // Host-visible inputs of a frame: the batch of every instance and the batch table
+    uint32_t* getInstanceBatches(uint32_t frame) const;
+    CullBatch* getBatches(uint32_t frame) const;
+
+    // Records culling and command generation. Must be outside of a render pass. The outputs
+    // are written by compute shaders, the caller synchronizes their readers
+    void record(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4& viewProj,
+        uint32_t instanceCount, uint32_t batchCount);
+
+    VkBuffer getCulledInstances(uint32_t frame) const
+    {
+        return frames[frame].culledInstances;
+    }
+
+    VkBuffer getDrawCommands(uint32_t frame) const
+    {
+        return frames[frame].drawCommands;
+    }
+
+    // Draw count lives at offset 0
+    VkBuffer getCounters(uint32_t frame) const
+    {
+        return frames[frame].counters;
+    }
+
+    static std::array<glm::vec4, 6> extractFrustumPlanes(const glm::mat4& viewProj);
+
+private:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    struct CullParams
+    {
+        std::array<glm::vec4, 6> frustumPlanes;
+        uint32_t instanceCount = 0;
+        uint32_t batchCount = 0;
+        uint32_t compact = 0;
+    };
+
+    struct FrameBuffers
+    {
+        VkBuffer instanceBatches = nullptr;
+        Allocation instanceBatchesMemory;
+        VkBuffer batches = nullptr;
+        Allocation batchesMemory;
+        VkBuffer culledInstances = nullptr;
+        Allocation culledInstancesMemory;
+        VkBuffer drawCommands = nullptr;
+        Allocation drawCommandsMemory;
+        VkBuffer counters = nullptr;
+        Allocation countersMemory;
+        VkDescriptorSet descriptorSet = nullptr;
+    };
+
+    void createPipelines(VkPipelineCache pipelineCache);
+    void createDescriptors(const std::vector<VkBuffer>& instanceBuffers);
+
+    VkDevice device = nullptr;
+    bool compact = false;
+    std::vector<FrameBuffers> frames;
+    VkDescriptorSetLayout descriptorSetLayout = nullptr;
+    VkDescriptorPool descriptorPool = nullptr;
+    VkPipelineLayout pipelineLayout = nullptr;
+    // Instance culling and command generation
+    std::array<VkPipeline, 2> pipelines{};
+};
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,325 @@
+#include "MemoryAllocator.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+uint32_t ceilLog2(VkDeviceSize value)
+{
+    uint32_t order = 0;
+    while ((VkDeviceSize{1} << order) < value) {
+        ++order;
+    }
+    return order;
+}
+
+uint32_t floorLog2(VkDeviceSize value)
+{
+    uint32_t order = 0;
+    while ((value >> (order + 1)) > 0) {
+        ++order;
+    }
+    return order;
+}
+} // namespace
+
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice)
+{
+    device = logicalDevice;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+}
+
+void MemoryAllocator::destroy()
+{
+    if (allocationCount > 0) {
+        spdlog::warn("Destroying memory allocator with {} live allocations", allocationCount);
+    }
+    for (auto& pool : pools) {
+        for (auto& block : pool.blocks) {
+            releaseBlock(block);
+        }
+    }
+    pools.clear();
+}
+
+uint32_t MemoryAllocator::findMemoryType(
+    uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
+        if ((typeFilter & (1u << i)) &&
+            (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Failed to find memory of the required type");
+}
+
+bool MemoryAllocator::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
+        if ((typeFilter & (1u << i)) &&
+            (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return true;
+        }
+    }
+    return false;
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(
+    VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped)
+{
+    VkMemoryAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex};
+    VkDeviceMemory memory = nullptr;
+    auto res = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+    if (res != VK_SUCCESS) {
+        spdlog::error(
+            "Failed allocating {} bytes of memory type {}: {}", size, memoryTypeIndex, res);
+        throw std::runtime_error("Failed to allocate device memory");
+    }
+    *mapped = nullptr;
+    if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        res = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped);
+        if (res != VK_SUCCESS) {
+            vkFreeMemory(device, memory, nullptr);
+            throw std::runtime_error("Failed to map device memory");
+        }
+    }
+    bytesReserved += size;
+    ++deviceMemoryCount;
+    return memory;
+}
+
+uint32_t MemoryAllocator::getPool(uint32_t memoryTypeIndex, ResourceKind kind)
+{
+    for (uint32_t i = 0; i < pools.size(); ++i) {
+        if (pools[i].memoryTypeIndex == memoryTypeIndex && pools[i].kind == kind) {
+            return i;
+        }
+    }
+    auto heapIndex = memProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    auto heapSize = memProperties.memoryHeaps[heapIndex].size;
+    // Small heaps (e.g. host-visible device-local windows) get proportionally smaller blocks
+    auto blockSize = std::min(MAX_BLOCK_SIZE, std::max(heapSize / 8, VkDeviceSize{1} << 20));
+    Pool pool{.memoryTypeIndex = memoryTypeIndex, .kind = kind, .blockOrder = floorLog2(blockSize)};
+    spdlog::debug("New memory pool: type {}, {}, {} KB blocks", memoryTypeIndex,
+        kind == ResourceKind::Linear ? "linear" : "optimal",
+        (VkDeviceSize{1} << pool.blockOrder) / 1024);
+    pools.push_back(std::move(pool));
+    return static_cast<uint32_t>(pools.size() - 1);
+}
+
+bool MemoryAllocator::allocateFromBlock(
+    Block& block, uint32_t order, uint32_t blockOrder, VkDeviceSize& offset)
+{
+    uint32_t available = order;
+    while (available <= blockOrder && block.freeLists[available - MIN_ORDER].empty()) {
+        ++available;
+    }
+    if (available > blockOrder) {
+        return false;
+    }
+    auto& list = block.freeLists[available - MIN_ORDER];
+    offset = *list.begin();
+    list.erase(list.begin());
+    // Split down to the requested order, returning the upper halves to the free lists
+    while (available > order) {
+        --available;
+        block.freeLists[available - MIN_ORDER].insert(offset + (VkDeviceSize{1} << available));
+    }
+    return true;
+}
+
+Allocation MemoryAllocator::allocate(
+    const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceKind kind)
+{
+    auto memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+    auto poolIdx = getPool(memoryTypeIndex, kind);
+    auto& pool = pools[poolIdx];
+
+    // Buddy nodes are aligned to their own size, so rounding up to the alignment is enough
+    auto order = std::max(ceilLog2(std::max(requirements.size, requirements.alignment)), MIN_ORDER);
+    Allocation allocation{.size = requirements.size, .pool = poolIdx, .order = order};
+
+    if (order >= pool.blockOrder) {
+        allocation.dedicated = true;
+        allocation.memory =
+            allocateDeviceMemory(requirements.size, memoryTypeIndex, &allocation.mapped);
+        bytesUsed += requirements.size;
+        bytesAllocated += requirements.size;
+        ++allocationCount;
+        return allocation;
+    }
+
+    bool found = false;
+    std::optional<uint32_t> emptySlot;
+    for (uint32_t i = 0; i < pool.blocks.size() && !found; ++i) {
+        auto& block = pool.blocks[i];
+        if (!block.memory) {
+            emptySlot = emptySlot.value_or(i);
+            continue;
+        }
+        if (allocateFromBlock(block, order, pool.blockOrder, allocation.offset)) {
+            allocation.block = i;
+            found = true;
+        }
+    }
+    if (!found) {
+        if (!emptySlot.has_value()) {
+            emptySlot = static_cast<uint32_t>(pool.blocks.size());
+            pool.blocks.emplace_back();
+        }
+        auto& block = pool.blocks[emptySlot.value()];
+        block.memory = allocateDeviceMemory(
+            VkDeviceSize{1} << pool.blockOrder, memoryTypeIndex, &block.mapped);
+        block.freeLists.assign(pool.blockOrder - MIN_ORDER + 1, {});
+        block.freeLists.back().insert(0);
+        block.allocatedBytes = 0;
+        allocateFromBlock(block, order, pool.blockOrder, allocation.offset);
+        allocation.block = emptySlot.value();
+    }
+
+    auto& block = pool.blocks[allocation.block];
+    block.allocatedBytes += VkDeviceSize{1} << order;
+    allocation.memory = block.memory;
+    if (block.mapped) {
+        allocation.mapped = static_cast<char*>(block.mapped) + allocation.offset;
+    }
+    bytesUsed += requirements.size;
+    bytesAllocated += VkDeviceSize{1} << order;
+    ++allocationCount;
+    return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation)
+{
+    if (!allocation.memory) {
+        return;
+    }
+    bytesUsed -= allocation.size;
+    --allocationCount;
+    if (allocation.dedicated) {
+        vkFreeMemory(device, allocation.memory, nullptr);
+        bytesAllocated -= allocation.size;
+        bytesReserved -= allocation.size;
+        --deviceMemoryCount;
+        allocation = Allocation{};
+        return;
+    }
+
+    auto& pool = pools[allocation.pool];
+    auto& block = pool.blocks[allocation.block];
+    auto nodeSize = VkDeviceSize{1} << allocation.order;
+    block.allocatedBytes -= nodeSize;
+    bytesAllocated -= nodeSize;
+
+    // Merge with the buddy for as long as it is free
+    auto offset = allocation.offset;
+    auto order = allocation.order;
+    while (order < pool.blockOrder) {
+        auto buddy = offset ^ (VkDeviceSize{1} << order);
+        auto& list = block.freeLists[order - MIN_ORDER];
+        auto it = list.find(buddy);
+        if (it == list.end()) {
+            break;
+        }
+        list.erase(it);
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+    block.freeLists[order - MIN_ORDER].insert(offset);
+
+    if (block.allocatedBytes == 0) {
+        // Keep one empty block around so alternating alloc/free doesn't hit vkAllocateMemory
+        auto liveBlocks = std::count_if(
+            pool.blocks.begin(), pool.blocks.end(), [](const auto& b) { return b.memory; });
+        if (liveBlocks > 1) {
+            releaseBlock(block);
+        }
+    }
+    allocation = Allocation{};
+}
+
+void MemoryAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory,
+    const std::vector<uint32_t>& sharedQueueFamilies)
+{
+    VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+    if (sharedQueueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharedQueueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = sharedQueueFamilies.data();
+    }
+    auto res = vkCreateBuffer(device, &bufferInfo, nullptr, &buffer);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create buffer");
+    }
+
+    VkMemoryRequirements memRequirements{};
+    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+    bufferMemory = allocate(memRequirements, properties, ResourceKind::Linear);
+    vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
+}
+
+void MemoryAllocator::destroyBuffer(VkBuffer& buffer, Allocation& bufferMemory)
+{
+    vkDestroyBuffer(device, buffer, nullptr);
+    buffer = nullptr;
+    free(bufferMemory);
+}
+
+void MemoryAllocator::releaseBlock(Block& block)
+{
+    if (!block.memory) {
+        return;
+    }
+    // Freeing implicitly unmaps
+    vkFreeMemory(device, block.memory, nullptr);
+    bytesReserved -= VkDeviceSize{1} << (block.freeLists.size() + MIN_ORDER - 1);
+    --deviceMemoryCount;
+    block = Block{};
+}
+
+MemoryStats MemoryAllocator::getStats() const
+{
+    MemoryStats stats{.bytesUsed = bytesUsed,
+        .bytesAllocated = bytesAllocated,
+        .bytesReserved = bytesReserved,
+        .allocationCount = allocationCount,
+        .deviceMemoryCount = deviceMemoryCount};
+
+    VkDeviceSize totalFree = 0;
+    VkDeviceSize largestFree = 0;
+    for (const auto& pool : pools) {
+        for (const auto& block : pool.blocks) {
+            if (!block.memory) {
+                continue;
+            }
+            totalFree += (VkDeviceSize{1} << pool.blockOrder) - block.allocatedBytes;
+            for (uint32_t order = pool.blockOrder; order >= MIN_ORDER; --order) {
+                if (!block.freeLists[order - MIN_ORDER].empty()) {
+                    largestFree = std::max(largestFree, VkDeviceSize{1} << order);
+                    break;
+                }
+            }
+        }
+    }
+    if (totalFree > 0) {
+        stats.fragmentation = 1.0f - static_cast<float>(static_cast<double>(largestFree) /
+                                                        static_cast<double>(totalFree));
+    }
+    return stats;
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Buffers and linear images must not share a block with optimal-tiling images, otherwise
+// neighbouring sub-allocations would have to be padded to bufferImageGranularity
+enum class ResourceKind { Linear, Optimal };
+
+struct Allocation
+{
+    VkDeviceMemory memory = nullptr;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // Start of the allocation for host-visible memory. Blocks are mapped once for their lifetime
+    void* mapped = nullptr;
+
+    uint32_t pool = 0;
+    uint32_t block = 0;
+    uint32_t order = 0;
+    bool dedicated = false;
+};
+
+struct MemoryStats
+{
+    // Sum of sizes requested by callers
+    VkDeviceSize bytesUsed = 0;
+    // Sum of sub-ranges handed out, including alignment and power-of-two rounding
+    VkDeviceSize bytesAllocated = 0;
+    // Sum of all live VkDeviceMemory objects
+    VkDeviceSize bytesReserved = 0;
+    uint32_t allocationCount = 0;
+    uint32_t deviceMemoryCount = 0;
+    // 1 - largest free range / total free bytes, over all blocks. 0 means no fragmentation
+    float fragmentation = 0.0f;
+};
+
+// Sub-allocates VkDeviceMemory blocks with a binary buddy allocator. Each memory type and
+// ResourceKind pair gets its own pool of blocks. Requests larger than half a block get a
+// dedicated VkDeviceMemory.
+class MemoryAllocator
+{
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device);
+    void destroy();
+
+    Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+        ResourceKind kind);
+    void free(Allocation& allocation);
+
+    // More than one queue family in sharedQueueFamilies creates the buffer with concurrent sharing
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+        VkBuffer& buffer, Allocation& bufferMemory,
+        const std::vector<uint32_t>& sharedQueueFamilies = {});
+    void destroyBuffer(VkBuffer& buffer, Allocation& bufferMemory);
+
+    MemoryStats getStats() const;
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+private:
+    static constexpr uint32_t MIN_ORDER = 8;
+    static constexpr VkDeviceSize MAX_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    struct Block
+    {
+        VkDeviceMemory memory = nullptr;
+        void* mapped = nullptr;
+        // Free node offsets for every order from MIN_ORDER up to the block order
+        std::vector<std::set<VkDeviceSize>> freeLists;
+        VkDeviceSize allocatedBytes = 0;
+    };
+
+    struct Pool
+    {
+        uint32_t memoryTypeIndex = 0;
+        ResourceKind kind = ResourceKind::Linear;
+        uint32_t blockOrder = 0;
+        std::vector<Block> blocks;
+    };
+
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, void** mapped);
+    uint32_t getPool(uint32_t memoryTypeIndex, ResourceKind kind);
+    bool allocateFromBlock(Block& block, uint32_t order, uint32_t blockOrder, VkDeviceSize& offset);
+    void releaseBlock(Block& block);
+
+    VkDevice device = nullptr;
+    VkPhysicalDeviceMemoryProperties memProperties{};
+    std::vector<Pool> pools;
+    VkDeviceSize bytesUsed = 0;
+    VkDeviceSize bytesAllocated = 0;
+    VkDeviceSize bytesReserved = 0;
+    uint32_t allocationCount = 0;
+    uint32_t deviceMemoryCount = 0;
+};
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,134 @@
+#include "MeshRegistry.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+glm::vec4 computeBoundingSphere(std::span<const Vertex> vertices)
+{
+    glm::vec3 minPos{std::numeric_limits<float>::max()};
+    glm::vec3 maxPos{std::numeric_limits<float>::lowest()};
+    for (const auto& vertex : vertices) {
+        minPos = glm::min(minPos, vertex.pos);
+        maxPos = glm::max(maxPos, vertex.pos);
+    }
+    auto center = (minPos + maxPos) * 0.5f;
+    float radius = 0.0f;
+    for (const auto& vertex : vertices) {
+        radius = std::max(radius, glm::length(vertex.pos - center));
+    }
+    return glm::vec4(center, radius);
+}
+} // namespace
+
+void MeshRegistry::init(MemoryAllocator& allocator,
+    const std::vector<uint32_t>& sharedQueueFamilies, uint32_t maxVertices, uint32_t maxIndices)
+{
+    vertexCapacity = maxVertices;
+    indexCapacity = maxIndices;
+    allocator.createBuffer(sizeof(Vertex) * vertexCapacity,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexMemory, sharedQueueFamilies);
+    allocator.createBuffer(sizeof(uint32_t) * indexCapacity,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexMemory, sharedQueueFamilies);
+}
+
+void MeshRegistry::destroy(MemoryAllocator& allocator)
+{
+    allocator.destroyBuffer(indexBuffer, indexMemory);
+    allocator.destroyBuffer(vertexBuffer, vertexMemory);
+    meshes.clear();
+    vertexCount = 0;
+    indexCount = 0;
+}
+
+MeshHandle MeshRegistry::add(UploadManager& uploads, const MeshData& mesh)
+{
+    return add(uploads, mesh.vertices, mesh.indices);
+}
+
+MeshHandle MeshRegistry::add(
+    UploadManager& uploads, std::span<const Vertex> vertices, std::span<const uint32_t> indices)
+{
+    auto newVertices = static_cast<uint32_t>(vertices.size());
+    auto newIndices = static_cast<uint32_t>(indices.size());
+    if (newVertices > vertexCapacity - vertexCount || newIndices > indexCapacity - indexCount) {
+        spdlog::error("Mesh with {} vertices and {} indices doesn't fit the registry", newVertices,
+            newIndices);
+        throw std::runtime_error("Mesh registry full");
+    }
+
+    uploads.uploadBuffer(vertexBuffer, sizeof(Vertex) * vertexCount, vertices.data(),
+        sizeof(Vertex) * newVertices);
+    uploads.uploadBuffer(indexBuffer, sizeof(uint32_t) * indexCount, indices.data(),
+        sizeof(uint32_t) * newIndices);
+
+    meshes.push_back(MeshInfo{.firstIndex = indexCount,
+        .indexCount = newIndices,
+        .vertexOffset = static_cast<int32_t>(vertexCount),
+        .boundingSphere = computeBoundingSphere(vertices)});
+    vertexCount += newVertices;
+    indexCount += newIndices;
+    return static_cast<MeshHandle>(meshes.size() - 1);
+}
+
+void MeshRegistry::bind(VkCommandBuffer commandBuffer) const
+{
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+MeshData makeQuad()
+{
+    MeshData mesh;
+    mesh.vertices = {
+        Vertex{.pos{-0.5f, -0.5f, 0.0f}, .color{1.0f, 0.0f, 0.0f}, .texCoord{1.0f, 0.0f}},
+        Vertex{.pos{0.5f, -0.5f, 0.0f}, .color{0.0f, 1.0f, 0.0f}, .texCoord{0.0f, 0.0f}},
+        Vertex{.pos{0.5f, 0.5f, 0.0f}, .color{0.0f, 0.0f, 1.0f}, .texCoord{0.0f, 1.0f}},
+        Vertex{.pos{-0.5f, 0.5f, 0.0f}, .color{1.0f, 1.0f, 1.0f}, .texCoord{1.0f, 1.0f}}};
+    mesh.indices = {0, 1, 2, 2, 3, 0};
+    return mesh;
+}
+
+MeshData makeCube()
+{
+    struct Face
+    {
+        glm::vec3 normal;
+        glm::vec3 u;
+        glm::vec3 v;
+    };
+    // u x v == normal, so every face winds counter-clockwise seen from outside
+    const std::array faces{Face{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},
+        Face{{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}}, Face{{0, 1, 0}, {0, 0, 1}, {1, 0, 0}},
+        Face{{0, -1, 0}, {1, 0, 0}, {0, 0, 1}}, Face{{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+        Face{{0, 0, -1}, {0, 1, 0}, {1, 0, 0}}};
+    const std::array<glm::vec2, 4> corners{
+        glm::vec2{-1, -1}, glm::vec2{1, -1}, glm::vec2{1, 1}, glm::vec2{-1, 1}};
+
+    MeshData mesh;
+    for (const auto& face : faces) {
+        auto base = static_cast<uint32_t>(mesh.vertices.size());
+        for (const auto& corner : corners) {
+            mesh.vertices.push_back(
+                Vertex{.pos = (face.normal + face.u * corner.x + face.v * corner.y) * 0.5f,
+                    .color = glm::abs(face.normal),
+                    .texCoord = (corner + 1.0f) * 0.5f});
+        }
+        for (uint32_t index : {0u, 1u, 2u, 2u, 3u, 0u}) {
+            mesh.indices.push_back(base + index);
+        }
+    }
+    return mesh;
+}
+
+} // namespace VaryZulu::Gfx
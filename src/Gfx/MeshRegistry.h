@@ -0,0 +1,76 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "Vertex.h"
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+using MeshHandle = uint32_t;
+
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Where a mesh lives in the shared buffers, in the terms vkCmdDrawIndexed takes
+struct MeshInfo
+{
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    int32_t vertexOffset = 0;
+    // Object space bounding sphere: xyz center, w radius
+    glm::vec4 boundingSphere{0.0f};
+};
+
+// Packs all meshes into one vertex buffer and one index buffer, so any mesh can be drawn
+// without rebinding. Meshes are appended and live until the registry is destroyed.
+class MeshRegistry
+{
+public:
+    void init(MemoryAllocator& allocator, const std::vector<uint32_t>& sharedQueueFamilies,
+        uint32_t vertexCapacity, uint32_t indexCapacity);
+    void destroy(MemoryAllocator& allocator);
+
+    // Records the upload of the mesh data. It is usable once the upload batch completes
+    MeshHandle add(UploadManager& uploads, const MeshData& mesh);
+    // Only reads the data while recording, it may live in a mapped file
+    MeshHandle add(UploadManager& uploads, std::span<const Vertex> vertices,
+        std::span<const uint32_t> indices);
+
+    const MeshInfo& get(MeshHandle mesh) const
+    {
+        return meshes[mesh];
+    }
+
+    size_t getMeshCount() const
+    {
+        return meshes.size();
+    }
+
+    // Binds the shared buffers as vertex binding 0 and the index buffer
+    void bind(VkCommandBuffer commandBuffer) const;
+
+private:
+    VkBuffer vertexBuffer = nullptr;
+    Allocation vertexMemory;
+    VkBuffer indexBuffer = nullptr;
+    Allocation indexMemory;
+    uint32_t vertexCapacity = 0;
+    uint32_t indexCapacity = 0;
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    std::vector<MeshInfo> meshes;
+};
+
+MeshData makeQuad();
+MeshData makeCube();
+
+} // namespace VaryZulu::Gfx
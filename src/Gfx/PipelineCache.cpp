@@ -0,0 +1,121 @@
+#include "PipelineCache.h"
+#include "Utils/Utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+// Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE, which every cache blob starts with
+struct CacheHeader
+{
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+static_assert(sizeof(CacheHeader) == 16 + VK_UUID_SIZE);
+} // namespace
+
+void PipelineCache::init(
+    VkDevice logicalDevice, const VkPhysicalDeviceProperties& properties, std::string cachePath)
+{
+    device = logicalDevice;
+    path = std::move(cachePath);
+    auto file = load(properties);
+    auto data = file ? file->getData() : std::span<const std::byte>{};
+
+    VkPipelineCacheCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = data.size(),
+        .pInitialData = data.empty() ? nullptr : data.data()};
+    auto res = vkCreatePipelineCache(device, &createInfo, nullptr, &cache);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache");
+    }
+    loadedSize = data.size();
+    if (loadedSize > 0) {
+        spdlog::info("Pipeline cache: loaded {} KB from {}", loadedSize / 1024, path);
+    } else {
+        spdlog::info("Pipeline cache: cold start");
+    }
+}
+
+std::optional<Utils::MappedFile> PipelineCache::load(
+    const VkPhysicalDeviceProperties& properties) const
+{
+    if (path.empty() || !std::filesystem::exists(path)) {
+        return {};
+    }
+    auto file = Utils::readFile(path);
+    auto data = file.getData();
+    CacheHeader header{};
+    if (data.size() < sizeof(header)) {
+        spdlog::warn("Pipeline cache {} is truncated, ignoring it", path);
+        return {};
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.headerSize < sizeof(header) || header.headerSize > data.size() ||
+        header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        spdlog::warn("Pipeline cache {} has an unknown header, ignoring it", path);
+        return {};
+    }
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+        memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        spdlog::info("Pipeline cache {} was written by another device or driver, ignoring it",
+            path);
+        return {};
+    }
+    return file;
+}
+
+void PipelineCache::save()
+{
+    if (path.empty() || !cache) {
+        return;
+    }
+    size_t size = 0;
+    auto res = vkGetPipelineCacheData(device, cache, &size, nullptr);
+    if (res != VK_SUCCESS) {
+        spdlog::warn("Failed to query pipeline cache size: {}", res);
+        return;
+    }
+    std::vector<char> data(size);
+    res = vkGetPipelineCacheData(device, cache, &size, data.data());
+    if (res != VK_SUCCESS) {
+        spdlog::warn("Failed to read pipeline cache data: {}", res);
+        return;
+    }
+
+    // Write next to the target and rename, so a crash never leaves a half written cache
+    auto tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(data.data(), static_cast<std::streamsize>(size))) {
+            spdlog::warn("Failed to write pipeline cache {}", tmpPath);
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        spdlog::warn("Failed to replace pipeline cache {}: {}", path, ec.message());
+        return;
+    }
+    spdlog::debug("Pipeline cache: saved {} KB to {}", size / 1024, path);
+}
+
+void PipelineCache::destroy()
+{
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = nullptr;
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Utils/MappedFile.h"
+#include "vk_wrap.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+namespace VaryZulu::Gfx
+{
+// VkPipelineCache persisted to a file. Data written by another device, driver or cache
+// layout is discarded on load, since drivers are not required to reject it themselves.
+class PipelineCache
+{
+public:
+    // An empty path keeps the cache in memory only
+    void init(VkDevice device, const VkPhysicalDeviceProperties& properties, std::string path);
+    // Writes the current cache contents back to the file
+    void save();
+    void destroy();
+
+    VkPipelineCache get() const
+    {
+        return cache;
+    }
+
+    // Size of the data that was accepted from the file, 0 for a cold start
+    size_t getLoadedSize() const
+    {
+        return loadedSize;
+    }
+
+private:
+    // Nothing if there is no usable cache file
+    std::optional<Utils::MappedFile> load(const VkPhysicalDeviceProperties& properties) const;
+
+    VkDevice device = nullptr;
+    VkPipelineCache cache = nullptr;
+    std::string path;
+    size_t loadedSize = 0;
+};
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,265 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+double percentile(std::vector<double>& values, double p)
+{
+    std::sort(values.begin(), values.end());
+    auto rank = static_cast<size_t>(p * static_cast<double>(values.size() - 1) + 0.5);
+    return values[rank];
+}
+} // namespace
+
+void Profiler::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, uint32_t queueFamily,
+    uint32_t frameSlots)
+{
+    device = logicalDevice;
+    history.resize(HISTORY_FRAMES);
+    gpuSlots.resize(frameSlots);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+    auto validBits = families.at(queueFamily).timestampValidBits;
+    if (validBits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+        spdlog::info("Profiler: no timestamp support, GPU timing disabled");
+        return;
+    }
+    timestampPeriodNs = static_cast<double>(properties.limits.timestampPeriod);
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = frameSlots * MAX_GPU_SCOPES * 2};
+    auto res = vkCreateQueryPool(device, &createInfo, nullptr, &queryPool);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool");
+    }
+}
+
+void Profiler::destroy()
+{
+    if (queryPool) {
+        vkDestroyQueryPool(device, queryPool, nullptr);
+        queryPool = nullptr;
+    }
+}
+
+double Profiler::nowMs() const
+{
+    return static_cast<double>(Utils::Trace::nowNs()) / 1'000'000.0;
+}
+
+void Profiler::beginFrame()
+{
+    auto& record = history[frameNumber % HISTORY_FRAMES];
+    record.frameNumber = frameNumber;
+    record.startMs = nowMs();
+    record.cpuMs = -1.0;
+    record.gpuMs = -1.0;
+    record.cpuEvents.clear();
+    record.gpuEvents.clear();
+    openScopes.clear();
+    frameOpen = true;
+}
+
+void Profiler::endFrame()
+{
+    if (!frameOpen) {
+        return;
+    }
+    auto& record = history[frameNumber % HISTORY_FRAMES];
+    record.cpuMs = nowMs() - record.startMs;
+    frameOpen = false;
+    ++frameNumber;
+}
+
+void Profiler::beginScope(const char* name)
+{
+    if (frameOpen) {
+        openScopes.emplace_back(name, nowMs());
+    }
+}
+
+void Profiler::endScope()
+{
+    if (!frameOpen || openScopes.empty()) {
+        return;
+    }
+    auto [name, startMs] = openScopes.back();
+    openScopes.pop_back();
+    history[frameNumber % HISTORY_FRAMES].cpuEvents.push_back(
+        Event{.name = name, .startMs = startMs, .durationMs = nowMs() - startMs});
+}
+
+void Profiler::collectGpuResults(uint32_t slot)
+{
+    auto& gpuSlot = gpuSlots[slot];
+    if (!queryPool || !gpuSlot.pending) {
+        return;
+    }
+    gpuSlot.pending = false;
+    auto& record = history[gpuSlot.frameNumber % HISTORY_FRAMES];
+    if (gpuSlot.scopeCount == 0 || record.frameNumber != gpuSlot.frameNumber) {
+        return;
+    }
+
+    std::array<uint64_t, MAX_GPU_SCOPES * 2> timestamps{};
+    auto queryCount = gpuSlot.scopeCount * 2;
+    auto res = vkGetQueryPoolResults(device, queryPool, slot * MAX_GPU_SCOPES * 2, queryCount,
+        queryCount * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT);
+    if (res != VK_SUCCESS) {
+        return;
+    }
+    auto toMs = [this](uint64_t ticks) {
+        return static_cast<double>(ticks & timestampMask) * timestampPeriodNs / 1e6;
+    };
+    // The first scope opens first and the outermost scope closes last, so together they span
+    // the GPU work of the frame
+    auto frameBegin = timestamps[0];
+    uint64_t frameTicks = 0;
+    for (uint32_t i = 0; i < gpuSlot.scopeCount; ++i) {
+        auto begin = timestamps[i * 2];
+        auto end = timestamps[i * 2 + 1];
+        record.gpuEvents.push_back(Event{.name = gpuSlot.names[i],
+            .startMs = gpuSlot.submitMs + toMs(begin - frameBegin),
+            .durationMs = toMs(end - begin)});
+        frameTicks = std::max(frameTicks, (end - frameBegin) & timestampMask);
+    }
+    record.gpuMs = toMs(frameTicks);
+}
+
+void Profiler::resetGpuScopes(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    auto& gpuSlot = gpuSlots[slot];
+    gpuSlot.scopeCount = 0;
+    gpuSlot.openScopes.clear();
+    if (queryPool) {
+        vkCmdResetQueryPool(
+            commandBuffer, queryPool, slot * MAX_GPU_SCOPES * 2, MAX_GPU_SCOPES * 2);
+    }
+}
+
+void Profiler::beginGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+{
+    auto& gpuSlot = gpuSlots[slot];
+    if (!queryPool || gpuSlot.scopeCount == MAX_GPU_SCOPES) {
+        return;
+    }
+    auto scope = gpuSlot.scopeCount++;
+    gpuSlot.names[scope] = name;
+    gpuSlot.openScopes.push_back(scope);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool,
+        (slot * MAX_GPU_SCOPES + scope) * 2);
+}
+
+void Profiler::endGpuScope(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+    auto& gpuSlot = gpuSlots[slot];
+    if (!queryPool || gpuSlot.openScopes.empty()) {
+        return;
+    }
+    auto scope = gpuSlot.openScopes.back();
+    gpuSlot.openScopes.pop_back();
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+        (slot * MAX_GPU_SCOPES + scope) * 2 + 1);
+}
+
+void Profiler::markSubmit(uint32_t slot)
+{
+    auto& gpuSlot = gpuSlots[slot];
+    gpuSlot.frameNumber = frameNumber;
+    gpuSlot.submitMs = nowMs();
+    gpuSlot.pending = frameOpen;
+}
+
+void Profiler::resetHistory()
+{
+    for (auto& record : history) {
+        record = FrameRecord{};
+    }
+    for (auto& gpuSlot : gpuSlots) {
+        gpuSlot.pending = false;
+    }
+}
+
+FrameTimeStats Profiler::getStats() const
+{
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+    for (const auto& record : history) {
+        if (record.cpuMs >= 0.0) {
+            cpuTimes.push_back(record.cpuMs);
+        }
+        if (record.gpuMs >= 0.0) {
+            gpuTimes.push_back(record.gpuMs);
+        }
+    }
+    FrameTimeStats stats{.cpuFrames = cpuTimes.size(), .gpuFrames = gpuTimes.size()};
+    if (!cpuTimes.empty()) {
+        stats.cpuP50 = percentile(cpuTimes, 0.50);
+        stats.cpuP95 = percentile(cpuTimes, 0.95);
+        stats.cpuP99 = percentile(cpuTimes, 0.99);
+    }
+    if (!gpuTimes.empty()) {
+        stats.gpuP50 = percentile(gpuTimes, 0.50);
+        stats.gpuP95 = percentile(gpuTimes, 0.95);
+        stats.gpuP99 = percentile(gpuTimes, 0.99);
+    }
+    return stats;
+}
+
+void Profiler::logStats(spdlog::level::level_enum level) const
+{
+    auto stats = getStats();
+    spdlog::log(level, "Frame CPU ms over {} frames: p50 {:.3f}, p95 {:.3f}, p99 {:.3f}",
+        stats.cpuFrames, stats.cpuP50, stats.cpuP95, stats.cpuP99);
+    if (stats.gpuFrames > 0) {
+        spdlog::log(level, "Frame GPU ms over {} frames: p50 {:.3f}, p95 {:.3f}, p99 {:.3f}",
+            stats.gpuFrames, stats.gpuP50, stats.gpuP95, stats.gpuP99);
+    }
+}
+
+void Profiler::writeChromeTrace(const std::string& path) const
+{
+    // Trace events are process 0
+    constexpr uint32_t pid = 1;
+    Utils::Trace::JsonWriter writer;
+    if (!writer.open(path)) {
+        spdlog::error("Failed to open profiler trace {}", path);
+        return;
+    }
+    writer.writeThreadName(pid, 0, "CPU");
+    writer.writeThreadName(pid, 1, "GPU");
+    auto writeEvent = [&](const char* name, uint32_t tid, double startMs, double durationMs) {
+        writer.writeEvent(name, pid, tid, static_cast<int64_t>(startMs * 1'000'000.0),
+            static_cast<int64_t>(durationMs * 1'000'000.0));
+    };
+    // Oldest frame first
+    for (size_t i = 0; i < HISTORY_FRAMES; ++i) {
+        const auto& record = history[(frameNumber + i) % HISTORY_FRAMES];
+        if (record.cpuMs < 0.0) {
+            continue;
+        }
+        writeEvent("Frame", 0, record.startMs, record.cpuMs);
+        for (const auto& event : record.cpuEvents) {
+            writeEvent(event.name, 0, event.startMs, event.durationMs);
+        }
+        for (const auto& event : record.gpuEvents) {
+            writeEvent(event.name, 1, event.startMs, event.durationMs);
+        }
+    }
+    writer.close();
+    spdlog::info("Wrote profiler trace to {}", path);
+}
+
+} // namespace VaryZulu::Gfx
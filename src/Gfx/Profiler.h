@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Utils/Trace.h"
+#include "vk_wrap.h"
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Nearest-rank percentiles in milliseconds over the recorded frame history
+struct FrameTimeStats
+{
+    size_t cpuFrames = 0;
+    double cpuP50 = 0.0;
+    double cpuP95 = 0.0;
+    double cpuP99 = 0.0;
+    size_t gpuFrames = 0;
+    double gpuP50 = 0.0;
+    double gpuP95 = 0.0;
+    double gpuP99 = 0.0;
+};
+
+// CPU frame and scope timing on steady_clock plus GPU pass timing from timestamp queries.
+// The last HISTORY_FRAMES frames are kept in a ring for percentiles and the Chrome trace dump.
+// CPU scopes are meant for the render thread only. GPU results of a frame slot are read back
+// once the slot's frame has finished, so they arrive a frame per frame in flight late.
+class Profiler
+{
+public:
+    static constexpr size_t HISTORY_FRAMES = 1024;
+    static constexpr uint32_t MAX_GPU_SCOPES = 16;
+
+    // Closes the innermost CPU scope when it goes out of scope. Also a trace marker, so
+    // profiled scopes show up in traces without a second annotation
+    class Scope
+    {
+    public:
+        Scope(Profiler& owner, const char* name)
+            : profiler(owner)
+#ifdef VZ_ENABLE_TRACING
+            , traceEvent(name)
+#endif
+        {
+            profiler.beginScope(name);
+        }
+        ~Scope()
+        {
+            profiler.endScope();
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler& profiler;
+#ifdef VZ_ENABLE_TRACING
+        Utils::Trace::ScopedEvent traceEvent;
+#endif
+    };
+
+    // GPU timing is disabled when the queue family has no timestamp support
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily,
+        uint32_t frameSlots);
+    void destroy();
+
+    void beginFrame();
+    void endFrame();
+    void beginScope(const char* name);
+    void endScope();
+
+    // Reads back the timestamps last submitted from a slot. Its frame must have finished
+    void collectGpuResults(uint32_t slot);
+    // Must be recorded outside of a render pass, before any GPU scope of the slot
+    void resetGpuScopes(VkCommandBuffer commandBuffer, uint32_t slot);
+    void beginGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+    void endGpuScope(VkCommandBuffer commandBuffer, uint32_t slot);
+    // Call right before the slot's command buffer is submitted
+    void markSubmit(uint32_t slot);
+
+    // Forgets all recorded frames, so stats cover only what follows. GPU results still pending
+    // are dropped, collect them first to keep them
+    void resetHistory();
+    FrameTimeStats getStats() const;
+    void logStats(spdlog::level::level_enum level) const;
+    // Chrome trace event format, open in chrome://tracing or Perfetto. GPU events are placed
+    // relative to the CPU submit time, since the two clocks are not calibrated. Written as
+    // process 1 on the Utils::Trace clock, so it merges with a --trace file
+    void writeChromeTrace(const std::string& path) const;
+
+private:
+    struct Event
+    {
+        const char* name = nullptr;
+        double startMs = 0.0;
+        double durationMs = 0.0;
+    };
+
+    struct FrameRecord
+    {
+        uint64_t frameNumber = 0;
+        double startMs = 0.0;
+        double cpuMs = -1.0;
+        // Negative until the frame's timestamps have been read back
+        double gpuMs = -1.0;
+        std::vector<Event> cpuEvents;
+        std::vector<Event> gpuEvents;
+    };
+
+    struct GpuSlot
+    {
+        uint64_t frameNumber = 0;
+        double submitMs = 0.0;
+        uint32_t scopeCount = 0;
+        bool pending = false;
+        std::array<const char*, MAX_GPU_SCOPES> names{};
+        std::vector<uint32_t> openScopes;
+    };
+
+    double nowMs() const;
+
+    VkDevice device = nullptr;
+    VkQueryPool queryPool = nullptr;
+    double timestampPeriodNs = 0.0;
+    uint64_t timestampMask = 0;
+    std::vector<GpuSlot> gpuSlots;
+    std::vector<FrameRecord> history;
+    uint64_t frameNumber = 0;
+    bool frameOpen = false;
+    std::vector<std::pair<const char*, double>> openScopes;
+};
+
+} // namespace VaryZulu::Gfx
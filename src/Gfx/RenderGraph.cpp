@@ -0,0 +1,829 @@
+#include "RenderGraph.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+constexpr VkPipelineStageFlags DEPTH_TEST_STAGES =
+    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+constexpr VkImageUsageFlags ATTACHMENT_USAGE = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                                               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                               VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+// Only images used as nothing but attachments may be transient attachments, and only those
+// may be bound to lazily allocated memory
+bool isAttachmentOnly(const GraphImageDesc& desc)
+{
+    return (desc.usage & ~ATTACHMENT_USAGE) == 0;
+}
+
+VkImageCreateInfo getImageInfo(const GraphImageDesc& desc)
+{
+    return VkImageCreateInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = desc.format,
+        .extent = VkExtent3D{.width = desc.width, .height = desc.height, .depth = 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = desc.usage |
+                 (isAttachmentOnly(desc) ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0u),
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+}
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+VkAttachmentLoadOp toLoadOp(AttachmentLoad load)
+{
+    switch (load) {
+        case AttachmentLoad::Clear:
+            return VK_ATTACHMENT_LOAD_OP_CLEAR;
+        case AttachmentLoad::Load:
+            return VK_ATTACHMENT_LOAD_OP_LOAD;
+        case AttachmentLoad::DontCare:
+            return VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    }
+    return VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+}
+} // namespace
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::colorAttachment(
+    GraphImage image, AttachmentLoad load, VkClearColorValue clear)
+{
+    bool read = load == AttachmentLoad::Load;
+    graph.addAccess(pass, Access{.resource = image,
+        .image = true,
+        .read = read,
+        .write = true,
+        .stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                  (read ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0u),
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+    VkClearValue clearValue{};
+    clearValue.color = clear;
+    graph.passes[pass].colorAttachments.push_back(
+        Attachment{.image = image, .load = load, .clear = clearValue});
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::depthAttachment(
+    GraphImage image, AttachmentLoad load, float clear)
+{
+    graph.addAccess(pass, Access{.resource = image,
+        .image = true,
+        .read = load == AttachmentLoad::Load,
+        .write = true,
+        .stages = DEPTH_TEST_STAGES,
+        .access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL});
+    VkClearValue clearValue{};
+    clearValue.depthStencil = {.depth = clear, .stencil = 0};
+    graph.passes[pass].depthAttachment =
+        Attachment{.image = image, .load = load, .clear = clearValue};
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::readImage(
+    GraphImage image, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout)
+{
+    graph.addAccess(pass, Access{.resource = image,
+        .image = true,
+        .read = true,
+        .write = false,
+        .stages = stages,
+        .access = access,
+        .layout = layout});
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::writeImage(
+    GraphImage image, VkPipelineStageFlags stages, VkAccessFlags access, VkImageLayout layout)
+{
+    graph.addAccess(pass, Access{.resource = image,
+        .image = true,
+        .read = false,
+        .write = true,
+        .stages = stages,
+        .access = access,
+        .layout = layout});
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::readBuffer(
+    GraphBuffer buffer, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+    graph.addAccess(pass, Access{.resource = buffer,
+        .image = false,
+        .read = true,
+        .write = false,
+        .stages = stages,
+        .access = access});
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::writeBuffer(
+    GraphBuffer buffer, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+    graph.addAccess(pass, Access{.resource = buffer,
+        .image = false,
+        .read = false,
+        .write = true,
+        .stages = stages,
+        .access = access});
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::secondaryCommandBuffers()
+{
+    graph.passes[pass].secondary = true;
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::sideEffects()
+{
+    graph.passes[pass].sideEffects = true;
+    return *this;
+}
+
+void RenderGraph::init(VkDevice vkDevice, MemoryAllocator& memoryAllocator, uint32_t frameCount)
+{
+    device = vkDevice;
+    allocator = &memoryAllocator;
+    framesInFlight = frameCount;
+}
+
+void RenderGraph::destroy()
+{
+    for (auto& [key, cached] : framebuffers) {
+        vkDestroyFramebuffer(device, cached.framebuffer, nullptr);
+    }
+    framebuffers.clear();
+    for (auto& [key, renderPass] : renderPasses) {
+        vkDestroyRenderPass(device, renderPass, nullptr);
+    }
+    renderPasses.clear();
+    for (auto& cached : cachedImages) {
+        vkDestroyImageView(device, cached.view, nullptr);
+        vkDestroyImage(device, cached.image, nullptr);
+    }
+    cachedImages.clear();
+    for (auto& heap : heaps) {
+        allocator->free(heap.memory);
+    }
+    heaps.clear();
+    for (auto& retired : retiredHeaps) {
+        allocator->free(retired.memory);
+    }
+    retiredHeaps.clear();
+    requirements.clear();
+    passes.clear();
+    images.clear();
+    buffers.clear();
+}
+
+void RenderGraph::beginFrame(uint64_t frame)
+{
+    frameNumber = frame;
+    passes.clear();
+    images.clear();
+    buffers.clear();
+
+    // Anything not used by the frames that may still be in flight is idle. Images go before
+    // the memory they are bound to
+    for (auto& cached : cachedImages) {
+        if (isUnused(cached.lastUsedFrame)) {
+            releaseView(cached.view);
+            vkDestroyImageView(device, cached.view, nullptr);
+            vkDestroyImage(device, cached.image, nullptr);
+        }
+    }
+    std::erase_if(cachedImages, [&](const auto& cached) { return isUnused(cached.lastUsedFrame); });
+    auto freeUnused = [&](auto& heap) {
+        if (!isUnused(heap.lastUsedFrame)) {
+            return false;
+        }
+        allocator->free(heap.memory);
+        return true;
+    };
+    std::erase_if(heaps, freeUnused);
+    std::erase_if(retiredHeaps, freeUnused);
+    std::erase_if(framebuffers, [&](const auto& entry) {
+        if (!isUnused(entry.second.lastUsedFrame)) {
+            return false;
+        }
+        vkDestroyFramebuffer(device, entry.second.framebuffer, nullptr);
+        return true;
+    });
+}
+
+GraphImage RenderGraph::importImage(VkImage image, VkImageView view, const GraphImageDesc& desc,
+    VkImageLayout initialLayout, VkPipelineStageFlags initialStages, VkImageLayout finalLayout)
+{
+    images.push_back(ImageResource{.desc = desc,
+        .image = image,
+        .view = view,
+        .finalLayout = finalLayout,
+        .state = ResourceState{.layout = initialLayout, .writeStages = initialStages}});
+    return static_cast<GraphImage>(images.size() - 1);
+}
+
+GraphImage RenderGraph::createImage(const GraphImageDesc& desc)
+{
+    images.push_back(ImageResource{.desc = desc, .transient = true});
+    return static_cast<GraphImage>(images.size() - 1);
+}
+
+GraphBuffer RenderGraph::importBuffer(VkBuffer buffer)
+{
+    buffers.push_back(BufferResource{.buffer = buffer});
+    return static_cast<GraphBuffer>(buffers.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(const char* name, ExecuteFn execute)
+{
+    passes.push_back(Pass{.name = name, .execute = std::move(execute)});
+    return PassBuilder(*this, static_cast<uint32_t>(passes.size() - 1));
+}
+
+void RenderGraph::addAccess(uint32_t pass, const Access& access)
+{
+    if (access.resource >= (access.image ? images.size() : buffers.size())) {
+        throw std::runtime_error("Render graph pass uses an undeclared resource");
+    }
+    passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, Profiler& profiler, uint32_t slot)
+{
+    cullPasses();
+    placeTransientImages();
+    for (size_t i = 0; i < passes.size(); ++i) {
+        auto& pass = passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        for (GraphImage image = 0; image < images.size(); ++image) {
+            if (images[image].transient && images[image].firstPass == i) {
+                beginLifetime(image);
+            }
+        }
+        BarrierBatch batch;
+        for (const auto& access : pass.accesses) {
+            addBarriers(access, batch);
+        }
+        batch.record(commandBuffer);
+        profiler.beginGpuScope(commandBuffer, slot, pass.name);
+        recordPass(commandBuffer, pass, i);
+        profiler.endGpuScope(commandBuffer, slot);
+    }
+
+    // Hand imported images back in the layout their owner expects. Heaps remember what the
+    // next frame has to wait for
+    for (auto& heap : heaps) {
+        if (heap.lastUsedFrame == frameNumber) {
+            heap.pendingStages = 0;
+            heap.pendingAccess = 0;
+        }
+    }
+    BarrierBatch batch;
+    for (uint32_t i = 0; i < images.size(); ++i) {
+        auto& image = images[i];
+        if (image.transient) {
+            if (image.firstPass != NO_PASS) {
+                heaps[image.heap].pendingStages |= image.state.writeStages | image.state.readStages;
+                heaps[image.heap].pendingAccess |= image.state.writeAccess;
+            }
+        } else if (image.state.layout != image.finalLayout) {
+            addBarriers(Access{.resource = i,
+                            .image = true,
+                            .read = true,
+                            .write = false,
+                            .stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            .access = 0,
+                            .layout = image.finalLayout},
+                batch);
+        }
+    }
+    batch.record(commandBuffer);
+}
+
+void RenderGraph::cullPasses()
+{
+    // Walking backwards, a pass is needed when it writes something a later needed pass reads,
+    // or an imported image
+    std::vector<bool> imageNeeded(images.size());
+    std::vector<bool> bufferNeeded(buffers.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        imageNeeded[i] = !images[i].transient;
+    }
+    uint32_t culled = 0;
+    for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass) {
+        auto needed = pass->sideEffects ||
+                      std::any_of(pass->accesses.begin(), pass->accesses.end(), [&](auto& access) {
+                          return access.write && (access.image ? imageNeeded[access.resource]
+                                                               : bufferNeeded[access.resource]);
+                      });
+        pass->culled = !needed;
+        if (!needed) {
+            ++culled;
+            continue;
+        }
+        for (const auto& access : pass->accesses) {
+            if (access.read) {
+                (access.image ? imageNeeded : bufferNeeded)[access.resource] = true;
+            }
+        }
+    }
+    if (culled != culledPassCount) {
+        spdlog::debug("Render graph culls {} of {} passes", culled, passes.size());
+    }
+    culledPassCount = culled;
+}
+
+void RenderGraph::placeTransientImages()
+{
+    for (uint32_t i = 0; i < passes.size(); ++i) {
+        if (passes[i].culled) {
+            continue;
+        }
+        for (const auto& access : passes[i].accesses) {
+            auto& image = images[access.resource];
+            if (access.image && image.transient) {
+                image.firstPass = std::min(image.firstPass, i);
+                image.lastPass = std::max(image.lastPass, i);
+            }
+        }
+    }
+
+    TransientMemoryStats stats;
+    std::vector<GraphImage> placed;
+    for (GraphImage i = 0; i < images.size(); ++i) {
+        auto& image = images[i];
+        if (!image.transient || image.firstPass == NO_PASS) {
+            continue;
+        }
+        const auto& req = getRequirements(image.desc);
+        auto lazy = isAttachmentOnly(image.desc) &&
+                    allocator->hasMemoryType(req.memoryTypeBits,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                            VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+        image.heap = getHeap(req.memoryTypeBits, lazy);
+        image.size = req.size;
+        placed.push_back(i);
+        ++stats.imageCount;
+        stats.unaliasedBytes += req.size;
+    }
+
+    // Largest first, each at the lowest offset clear of the images alive at the same time.
+    // The order is stable, so an unchanged graph gets the same placement every frame
+    std::stable_sort(placed.begin(), placed.end(),
+        [&](GraphImage a, GraphImage b) { return images[a].size > images[b].size; });
+    std::vector<VkDeviceSize> heapSizes(heaps.size());
+    std::vector<VkDeviceSize> heapAlignments(heaps.size(), 1);
+    for (size_t i = 0; i < placed.size(); ++i) {
+        auto& image = images[placed[i]];
+        auto alignment = getRequirements(image.desc).alignment;
+        std::vector<const ImageResource*> conflicts;
+        for (size_t j = 0; j < i; ++j) {
+            const auto& other = images[placed[j]];
+            if (other.heap == image.heap && other.firstPass <= image.lastPass &&
+                image.firstPass <= other.lastPass) {
+                conflicts.push_back(&other);
+            }
+        }
+        auto overlaps = [&](VkDeviceSize offset) {
+            return std::any_of(conflicts.begin(), conflicts.end(), [&](auto* other) {
+                return offset < other->offset + other->size && other->offset < offset + image.size;
+            });
+        };
+        // The lowest free spot starts at 0 or right after a conflict, and the highest end
+        // always fits
+        VkDeviceSize offset = 0;
+        if (overlaps(offset)) {
+            offset = ~VkDeviceSize{0};
+            for (auto* other : conflicts) {
+                auto candidate = alignUp(other->offset + other->size, alignment);
+                if (candidate < offset && !overlaps(candidate)) {
+                    offset = candidate;
+                }
+            }
+        }
+        image.offset = offset;
+        heapSizes[image.heap] = std::max(heapSizes[image.heap], offset + image.size);
+        heapAlignments[image.heap] = std::max(heapAlignments[image.heap], alignment);
+    }
+
+    for (uint32_t i = 0; i < heaps.size(); ++i) {
+        if (heapSizes[i] == 0) {
+            continue;
+        }
+        reserveHeap(heaps[i], heapSizes[i], heapAlignments[i]);
+        stats.peakBytes += heapSizes[i];
+        stats.lazyBytes += heaps[i].lazy ? heapSizes[i] : 0;
+        stats.reservedBytes += heaps[i].memory.size;
+    }
+    for (auto i : placed) {
+        auto& image = images[i];
+        const auto& cached = getCachedImage(image.desc, heaps[image.heap], image.offset);
+        image.image = cached.image;
+        image.view = cached.view;
+    }
+
+    if (stats.peakBytes != transientStats.peakBytes ||
+        stats.unaliasedBytes != transientStats.unaliasedBytes) {
+        spdlog::debug("Transient images: {} KB peak for {} images of {} KB, {} KB lazily "
+                      "allocated",
+            stats.peakBytes / 1024, stats.imageCount, stats.unaliasedBytes / 1024,
+            stats.lazyBytes / 1024);
+    }
+    transientStats = stats;
+}
+
+uint32_t RenderGraph::getHeap(uint32_t memoryTypeBits, bool lazy)
+{
+    for (uint32_t i = 0; i < heaps.size(); ++i) {
+        if (heaps[i].memoryTypeBits == memoryTypeBits && heaps[i].lazy == lazy) {
+            return i;
+        }
+    }
+    heaps.push_back(TransientHeap{.memoryTypeBits = memoryTypeBits, .lazy = lazy});
+    return static_cast<uint32_t>(heaps.size() - 1);
+}
+
+void RenderGraph::reserveHeap(TransientHeap& heap, VkDeviceSize size, VkDeviceSize alignment)
+{
+    heap.lastUsedFrame = frameNumber;
+    // Shrinks too, after a resize to a smaller swapchain
+    if (heap.memory.memory && size <= heap.memory.size && size * 2 > heap.memory.size &&
+        alignment <= heap.alignment) {
+        return;
+    }
+    if (heap.memory.memory) {
+        // The frames in flight may still use it
+        retiredHeaps.push_back(RetiredHeap{.memory = heap.memory, .lastUsedFrame = frameNumber});
+    }
+    VkMemoryRequirements heapRequirements{
+        .size = size, .alignment = alignment, .memoryTypeBits = heap.memoryTypeBits};
+    auto properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                      (heap.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0u);
+    heap.memory = allocator->allocate(heapRequirements, properties, ResourceKind::Optimal);
+    heap.alignment = alignment;
+    heap.id = nextHeapId++;
+    // Fresh memory, nothing to wait for
+    heap.pendingStages = 0;
+    heap.pendingAccess = 0;
+    spdlog::debug("Reserved a {} KB transient heap{}", size / 1024,
+        heap.lazy ? " in lazily allocated memory" : "");
+}
+
+const VkMemoryRequirements& RenderGraph::getRequirements(const GraphImageDesc& desc)
+{
+    if (auto it = requirements.find(desc); it != requirements.end()) {
+        return it->second;
+    }
+    // Placement needs the requirements before any image is bound, so they come from an image
+    // created only to query them
+    auto imageInfo = getImageInfo(desc);
+    VkImage image = nullptr;
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create transient image");
+    }
+    VkMemoryRequirements imageRequirements{};
+    vkGetImageMemoryRequirements(device, image, &imageRequirements);
+    vkDestroyImage(device, image, nullptr);
+    return requirements.emplace(desc, imageRequirements).first->second;
+}
+
+const RenderGraph::CachedImage& RenderGraph::getCachedImage(
+    const GraphImageDesc& desc, const TransientHeap& heap, VkDeviceSize offset)
+{
+    auto it = std::find_if(cachedImages.begin(), cachedImages.end(), [&](const auto& cached) {
+        return cached.desc == desc && cached.heapId == heap.id && cached.offset == offset;
+    });
+    if (it != cachedImages.end()) {
+        it->lastUsedFrame = frameNumber;
+        return *it;
+    }
+
+    CachedImage cached{
+        .desc = desc, .heapId = heap.id, .offset = offset, .lastUsedFrame = frameNumber};
+    auto imageInfo = getImageInfo(desc);
+    if (vkCreateImage(device, &imageInfo, nullptr, &cached.image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create transient image");
+    }
+    vkBindImageMemory(device, cached.image, heap.memory.memory, heap.memory.offset + offset);
+    VkImageViewCreateInfo viewInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = cached.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = desc.format,
+        .subresourceRange = VkImageSubresourceRange{.aspectMask = desc.aspect,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1}};
+    if (vkCreateImageView(device, &viewInfo, nullptr, &cached.view) != VK_SUCCESS) {
+        vkDestroyImage(device, cached.image, nullptr);
+        throw std::runtime_error("Failed to create transient image view");
+    }
+    spdlog::debug("Created a {}x{} transient image at offset {} KB", desc.width, desc.height,
+        offset / 1024);
+    cachedImages.push_back(cached);
+    return cachedImages.back();
+}
+
+void RenderGraph::beginLifetime(GraphImage image)
+{
+    // Contents are discarded, but whatever used the memory before has to finish: the last frame
+    // in this heap, and images of this frame placed over the same range that are done
+    auto& resource = images[image];
+    const auto& heap = heaps[resource.heap];
+    ResourceState state{.layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .writeStages = heap.pendingStages,
+        .writeAccess = heap.pendingAccess};
+    for (const auto& other : images) {
+        if (other.transient && other.firstPass != NO_PASS && other.heap == resource.heap &&
+            other.lastPass < resource.firstPass && other.offset < resource.offset + resource.size &&
+            resource.offset < other.offset + other.size) {
+            state.writeStages |= other.state.writeStages | other.state.readStages;
+            state.writeAccess |= other.state.writeAccess;
+        }
+    }
+    resource.state = state;
+}
+
+void RenderGraph::addBarriers(const Access& access, BarrierBatch& batch)
+{
+    auto& state = access.image ? images[access.resource].state : buffers[access.resource].state;
+    // A layout transition writes the image, so it orders like a write
+    bool transition = access.image && access.layout != state.layout;
+    bool write = access.write || transition;
+    bool hazard = false;
+    if (write) {
+        // Write after write, and write after read
+        hazard = (state.writeStages | state.readStages) != 0;
+    } else {
+        // Read after write, unless an earlier barrier already made the write visible here
+        hazard = state.writeStages != 0 && ((access.stages & ~state.visibleStages) != 0 ||
+                                               (access.access & ~state.visibleAccess) != 0);
+    }
+
+    if (hazard || transition) {
+        batch.srcStages |= state.writeStages | (write ? state.readStages : 0);
+        batch.dstStages |= access.stages;
+        if (transition) {
+            const auto& image = images[access.resource];
+            batch.imageBarriers.push_back(VkImageMemoryBarrier{
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = state.writeAccess,
+                .dstAccessMask = access.access,
+                // Contents nobody reads may be discarded, which is cheaper
+                .oldLayout = access.read ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED,
+                .newLayout = access.layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = image.image,
+                .subresourceRange = VkImageSubresourceRange{.aspectMask = image.desc.aspect,
+                    .baseMipLevel = 0,
+                    .levelCount = VK_REMAINING_MIP_LEVELS,
+                    .baseArrayLayer = 0,
+                    .layerCount = VK_REMAINING_ARRAY_LAYERS}});
+        } else {
+            batch.memoryBarrier.srcAccessMask |= state.writeAccess;
+            batch.memoryBarrier.dstAccessMask |= access.access;
+        }
+    }
+
+    state.layout = access.image ? access.layout : state.layout;
+    if (write) {
+        // After a transition for a read, the transition is the write later readers wait for.
+        // The barrier already made it visible to this access
+        state.writeStages = access.stages;
+        state.writeAccess = access.write ? access.access : 0;
+        state.readStages = access.write ? 0 : access.stages;
+        state.visibleStages = access.write ? 0 : access.stages;
+        state.visibleAccess = access.write ? 0 : access.access;
+    } else {
+        state.readStages |= access.stages;
+        if (hazard) {
+            state.visibleStages |= access.stages;
+            state.visibleAccess |= access.access;
+        }
+    }
+}
+
+void RenderGraph::BarrierBatch::record(VkCommandBuffer commandBuffer)
+{
+    if (dstStages == 0) {
+        return;
+    }
+    bool hasMemoryBarrier = (memoryBarrier.srcAccessMask | memoryBarrier.dstAccessMask) != 0;
+    vkCmdPipelineBarrier(commandBuffer,
+        srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, 0,
+        hasMemoryBarrier ? 1u : 0u, &memoryBarrier, 0, nullptr,
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::recordPass(VkCommandBuffer commandBuffer, Pass& pass, size_t passIdx)
+{
+    if (pass.colorAttachments.empty() && !pass.depthAttachment) {
+        pass.execute(PassContext{.commandBuffer = commandBuffer});
+        return;
+    }
+
+    RenderPassKey key;
+    FramebufferKey framebufferKey;
+    std::vector<VkClearValue> clearValues;
+    auto addAttachment = [&](const Attachment& attachment) {
+        const auto& image = images[attachment.image];
+        if (!framebufferKey.views.empty() && (image.desc.width != framebufferKey.width ||
+                                                 image.desc.height != framebufferKey.height)) {
+            throw std::runtime_error("Render graph attachments differ in size");
+        }
+        // Nothing reads it later, so tilers may drop it instead of writing it out
+        key.attachments.push_back(AttachmentKey{.format = image.desc.format,
+            .load = toLoadOp(attachment.load),
+            .store = image.transient && !isReadAfter(attachment.image, passIdx)
+                         ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                         : VK_ATTACHMENT_STORE_OP_STORE});
+        framebufferKey.views.push_back(image.view);
+        framebufferKey.width = image.desc.width;
+        framebufferKey.height = image.desc.height;
+        clearValues.push_back(attachment.clear);
+    };
+    for (const auto& attachment : pass.colorAttachments) {
+        addAttachment(attachment);
+    }
+    if (pass.depthAttachment) {
+        addAttachment(*pass.depthAttachment);
+        key.hasDepth = true;
+    }
+
+    VkExtent2D extent{.width = framebufferKey.width, .height = framebufferKey.height};
+    auto renderPass = getRenderPass(key);
+    framebufferKey.renderPass = renderPass;
+    auto framebuffer = getFramebuffer(std::move(framebufferKey));
+    VkRenderPassBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = renderPass,
+        .framebuffer = framebuffer,
+        .renderArea = VkRect2D{.offset = {0, 0}, .extent = extent},
+        .clearValueCount = static_cast<uint32_t>(clearValues.size()),
+        .pClearValues = clearValues.data()};
+    vkCmdBeginRenderPass(commandBuffer, &beginInfo,
+        pass.secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                       : VK_SUBPASS_CONTENTS_INLINE);
+    pass.execute(PassContext{.commandBuffer = commandBuffer,
+        .renderPass = renderPass,
+        .framebuffer = framebuffer,
+        .extent = extent});
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+bool RenderGraph::isReadAfter(GraphImage image, size_t passIdx) const
+{
+    for (auto i = passIdx + 1; i < passes.size(); ++i) {
+        if (passes[i].culled) {
+            continue;
+        }
+        for (const auto& access : passes[i].accesses) {
+            if (access.image && access.resource == image) {
+                // Only the next access matters, a write without reading starts over
+                return access.read;
+            }
+        }
+    }
+    return false;
+}
+
+VkRenderPass RenderGraph::getCompatibleRenderPass(
+    std::span<const VkFormat> colorFormats, VkFormat depthFormat)
+{
+    // The ops of a frame that clears everything and keeps only the color
+    RenderPassKey key;
+    for (auto format : colorFormats) {
+        key.attachments.push_back(AttachmentKey{.format = format,
+            .load = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .store = VK_ATTACHMENT_STORE_OP_STORE});
+    }
+    if (depthFormat != VK_FORMAT_UNDEFINED) {
+        key.attachments.push_back(AttachmentKey{.format = depthFormat,
+            .load = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .store = VK_ATTACHMENT_STORE_OP_DONT_CARE});
+        key.hasDepth = true;
+    }
+    return getRenderPass(key);
+}
+
+VkRenderPass RenderGraph::getRenderPass(const RenderPassKey& key)
+{
+    if (auto it = renderPasses.find(key); it != renderPasses.end()) {
+        return it->second;
+    }
+
+    // Layouts are changed by the graph's barriers, so each attachment stays in the layout its
+    // subpass uses and no external dependencies are needed
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference> colorRefs;
+    VkAttachmentReference depthRef{};
+    for (size_t i = 0; i < key.attachments.size(); ++i) {
+        bool depth = key.hasDepth && i + 1 == key.attachments.size();
+        auto layout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                            : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        const auto& attachment = key.attachments[i];
+        attachments.push_back(VkAttachmentDescription{.format = attachment.format,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+            .loadOp = attachment.load,
+            .storeOp = attachment.store,
+            .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+            .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+            .initialLayout = layout,
+            .finalLayout = layout});
+        VkAttachmentReference ref{.attachment = static_cast<uint32_t>(i), .layout = layout};
+        if (depth) {
+            depthRef = ref;
+        } else {
+            colorRefs.push_back(ref);
+        }
+    }
+    VkSubpassDescription subpass{.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount = static_cast<uint32_t>(colorRefs.size()),
+        .pColorAttachments = colorRefs.data(),
+        .pDepthStencilAttachment = key.hasDepth ? &depthRef : nullptr};
+    VkRenderPassCreateInfo renderPassInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = static_cast<uint32_t>(attachments.size()),
+        .pAttachments = attachments.data(),
+        .subpassCount = 1,
+        .pSubpasses = &subpass};
+    VkRenderPass renderPass = nullptr;
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed creating a render pass");
+    }
+    renderPasses.emplace(key, renderPass);
+    return renderPass;
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(FramebufferKey&& key)
+{
+    if (auto it = framebuffers.find(key); it != framebuffers.end()) {
+        it->second.lastUsedFrame = frameNumber;
+        return it->second.framebuffer;
+    }
+    VkFramebufferCreateInfo framebufferInfo{.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .renderPass = key.renderPass,
+        .attachmentCount = static_cast<uint32_t>(key.views.size()),
+        .pAttachments = key.views.data(),
+        .width = key.width,
+        .height = key.height,
+        .layers = 1};
+    VkFramebuffer framebuffer = nullptr;
+    if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create a frame buffer");
+    }
+    framebuffers.emplace(std::move(key),
+        CachedFramebuffer{.framebuffer = framebuffer, .lastUsedFrame = frameNumber});
+    return framebuffer;
+}
+
+void RenderGraph::releaseView(VkImageView view)
+{
+    std::erase_if(framebuffers, [&](const auto& entry) {
+        const auto& views = entry.first.views;
+        if (std::find(views.begin(), views.end(), view) == views.end()) {
+            return false;
+        }
+        vkDestroyFramebuffer(device, entry.second.framebuffer, nullptr);
+        return true;
+    });
+}
+
+bool RenderGraph::isUnused(uint64_t lastUsedFrame) const
+{
+    // The frame pacer lets frame n begin only once frame n - framesInFlight has finished, so
+    // everything used that far back is idle
+    return frameNumber >= lastUsedFrame + framesInFlight;
+}
+
+size_t RenderGraph::FramebufferKeyHash::operator()(const FramebufferKey& key) const
+{
+    auto hash = std::hash<VkRenderPass>{}(key.renderPass);
+    auto combine = [&](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+    for (auto view : key.views) {
+        combine(std::hash<VkImageView>{}(view));
+    }
+    combine(std::hash<uint32_t>{}(key.width));
+    combine(std::hash<uint32_t>{}(key.height));
+    return hash;
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,342 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+#include "Profiler.h"
+
+#include "vk_wrap.h"
+
+#include <compare>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+using GraphImage = uint32_t;
+using GraphBuffer = uint32_t;
+
+enum class AttachmentLoad { Clear, Load, DontCare };
+
+// Transient image memory of the last execute()
+struct TransientMemoryStats
+{
+    uint32_t imageCount = 0;
+    // What the images would take with memory of their own
+    VkDeviceSize unaliasedBytes = 0;
+    // End of the highest placed image, summed over heaps
+    VkDeviceSize peakBytes = 0;
+    // Part of peakBytes in lazily allocated memory
+    VkDeviceSize lazyBytes = 0;
+    // Size of the heaps backing them
+    VkDeviceSize reservedBytes = 0;
+};
+
+struct GraphImageDesc
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+
+    auto operator<=>(const GraphImageDesc&) const = default;
+};
+
+// What a pass's execute callback records into. Graphics passes run inside the render pass
+// the graph began for them
+struct PassContext
+{
+    VkCommandBuffer commandBuffer = nullptr;
+    // Null for passes without attachments
+    VkRenderPass renderPass = nullptr;
+    VkFramebuffer framebuffer = nullptr;
+    VkExtent2D extent{};
+};
+
+// Records one frame's passes from the resources they declare. Passes run in the order they
+// were added. Barriers and layout transitions between them are derived from the declared
+// accesses and merged into one vkCmdPipelineBarrier per pass. Passes whose writes nothing
+// reads are culled. Imported images count as read after the frame, imported buffers don't, so
+// a pass writing only buffers needs a reader or sideEffects(). Attachments get render passes
+// and framebuffers from caches, stored only when something reads them later.
+//
+// Images created by the graph are transient: their contents don't outlive the frame. Their
+// lifetimes span the first to the last surviving pass using them, and images whose lifetimes
+// don't overlap are placed at the same offsets of a shared heap. Attachment-only images go to
+// lazily allocated memory when the device has it, which tilers may never back. Heaps and
+// images are kept across frames while the placement holds and destroyed once unused for
+// framesInFlight frames. Frames must be submitted in order to a single queue.
+class RenderGraph
+{
+public:
+    using ExecuteFn = std::function<void(const PassContext&)>;
+
+    // Declares what a pass touches. Only valid until the next addPass()
+    class PassBuilder
+    {
+    public:
+        PassBuilder& colorAttachment(
+            GraphImage image, AttachmentLoad load, VkClearColorValue clear = {});
+        // Read and written, depth testing can happen in either fragment test stage
+        PassBuilder& depthAttachment(GraphImage image, AttachmentLoad load, float clear = 1.0f);
+        PassBuilder& readImage(GraphImage image, VkPipelineStageFlags stages,
+            VkAccessFlags access, VkImageLayout layout);
+        PassBuilder& writeImage(GraphImage image, VkPipelineStageFlags stages,
+            VkAccessFlags access, VkImageLayout layout);
+        PassBuilder& readBuffer(
+            GraphBuffer buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+        PassBuilder& writeBuffer(
+            GraphBuffer buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+        // The render pass contents are recorded in secondary command buffers
+        PassBuilder& secondaryCommandBuffers();
+        // Never culled
+        PassBuilder& sideEffects();
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& owner, uint32_t passIdx) : graph(owner), pass(passIdx)
+        {
+        }
+
+        RenderGraph& graph;
+        uint32_t pass;
+    };
+
+    void init(VkDevice device, MemoryAllocator& allocator, uint32_t framesInFlight);
+    void destroy();
+
+    // Starts declaring a frame. Must be called once per submitted frame, with the count of
+    // frames submitted before it
+    void beginFrame(uint64_t frameNumber);
+
+    // Imported resources must not be in use by earlier frames anymore, except by initialStages,
+    // e.g. the stage waiting on a swapchain acquire. The image is left in finalLayout
+    GraphImage importImage(VkImage image, VkImageView view, const GraphImageDesc& desc,
+        VkImageLayout initialLayout, VkPipelineStageFlags initialStages,
+        VkImageLayout finalLayout);
+    GraphImage createImage(const GraphImageDesc& desc);
+    GraphBuffer importBuffer(VkBuffer buffer);
+    // name has to be a string literal, the profiler keeps the pointer
+    PassBuilder addPass(const char* name, ExecuteFn execute);
+
+    // Culls, computes barriers and records every remaining pass, each in a GPU scope named
+    // after it
+    void execute(VkCommandBuffer commandBuffer, Profiler& profiler, uint32_t slot);
+
+    // For building pipelines and inheriting in secondary command buffers. Render passes that
+    // only differ in load and store ops or layouts are compatible
+    VkRenderPass getCompatibleRenderPass(
+        std::span<const VkFormat> colorFormats, VkFormat depthFormat);
+    // Destroys the cached framebuffers using view. Call before destroying an imported view,
+    // once no frame in flight uses it
+    void releaseView(VkImageView view);
+
+    // Passes culled by the last execute()
+    uint32_t getCulledPassCount() const
+    {
+        return culledPassCount;
+    }
+
+    const TransientMemoryStats& getTransientStats() const
+    {
+        return transientStats;
+    }
+
+private:
+    // Pending work on a resource, what the next access has to wait for
+    struct ResourceState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags writeStages = 0;
+        VkAccessFlags writeAccess = 0;
+        // Reads since the last write, a write has to wait for them
+        VkPipelineStageFlags readStages = 0;
+        // Made visible since the last write
+        VkPipelineStageFlags visibleStages = 0;
+        VkAccessFlags visibleAccess = 0;
+    };
+
+    struct Access
+    {
+        uint32_t resource = 0;
+        bool image = false;
+        // Of the previous contents
+        bool read = false;
+        bool write = false;
+        VkPipelineStageFlags stages = 0;
+        VkAccessFlags access = 0;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    struct Attachment
+    {
+        GraphImage image = 0;
+        AttachmentLoad load = AttachmentLoad::DontCare;
+        VkClearValue clear{};
+    };
+
+    struct Pass
+    {
+        const char* name = nullptr;
+        ExecuteFn execute;
+        std::vector<Access> accesses;
+        std::vector<Attachment> colorAttachments;
+        std::optional<Attachment> depthAttachment;
+        bool secondary = false;
+        bool sideEffects = false;
+        bool culled = false;
+    };
+
+    static constexpr uint32_t NO_PASS = ~0u;
+
+    struct ImageResource
+    {
+        GraphImageDesc desc;
+        // Bound by execute() for transient images
+        VkImage image = nullptr;
+        VkImageView view = nullptr;
+        bool transient = false;
+        // Lifetime and placement of transient images. Images no surviving pass uses stay
+        // unplaced
+        uint32_t firstPass = NO_PASS;
+        uint32_t lastPass = 0;
+        uint32_t heap = 0;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        ResourceState state;
+    };
+
+    struct BufferResource
+    {
+        VkBuffer buffer = nullptr;
+        ResourceState state;
+    };
+
+    // Memory transient images are placed in. Images only share a heap when they accept the
+    // same memory types
+    struct TransientHeap
+    {
+        uint32_t memoryTypeBits = 0;
+        bool lazy = false;
+        Allocation memory;
+        VkDeviceSize alignment = 0;
+        // Changes with every reallocation, images bound to the old memory can't be reused
+        uint64_t id = 0;
+        uint64_t lastUsedFrame = 0;
+        // Work of the last frame in the heap, the next frame's first accesses wait on it
+        VkPipelineStageFlags pendingStages = 0;
+        VkAccessFlags pendingAccess = 0;
+    };
+
+    struct RetiredHeap
+    {
+        Allocation memory;
+        uint64_t lastUsedFrame = 0;
+    };
+
+    // An image bound at a heap offset
+    struct CachedImage
+    {
+        GraphImageDesc desc;
+        uint64_t heapId = 0;
+        VkDeviceSize offset = 0;
+        VkImage image = nullptr;
+        VkImageView view = nullptr;
+        uint64_t lastUsedFrame = 0;
+    };
+
+    struct AttachmentKey
+    {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkAttachmentLoadOp load = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        VkAttachmentStoreOp store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+        auto operator<=>(const AttachmentKey&) const = default;
+    };
+
+    // Depth last when present
+    struct RenderPassKey
+    {
+        std::vector<AttachmentKey> attachments;
+        bool hasDepth = false;
+
+        auto operator<=>(const RenderPassKey&) const = default;
+    };
+
+    struct FramebufferKey
+    {
+        VkRenderPass renderPass = nullptr;
+        std::vector<VkImageView> views;
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        bool operator==(const FramebufferKey&) const = default;
+    };
+
+    struct FramebufferKeyHash
+    {
+        size_t operator()(const FramebufferKey& key) const;
+    };
+
+    struct CachedFramebuffer
+    {
+        VkFramebuffer framebuffer = nullptr;
+        uint64_t lastUsedFrame = 0;
+    };
+
+    // Accumulates the barriers recorded before one pass
+    struct BarrierBatch
+    {
+        VkPipelineStageFlags srcStages = 0;
+        VkPipelineStageFlags dstStages = 0;
+        VkMemoryBarrier memoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+
+        void record(VkCommandBuffer commandBuffer);
+    };
+
+    void addAccess(uint32_t pass, const Access& access);
+    void cullPasses();
+    // Computes lifetimes, places transient images in heaps and binds them
+    void placeTransientImages();
+    uint32_t getHeap(uint32_t memoryTypeBits, bool lazy);
+    void reserveHeap(TransientHeap& heap, VkDeviceSize size, VkDeviceSize alignment);
+    const VkMemoryRequirements& getRequirements(const GraphImageDesc& desc);
+    const CachedImage& getCachedImage(
+        const GraphImageDesc& desc, const TransientHeap& heap, VkDeviceSize offset);
+    // The first access of a transient image waits for earlier users of its memory
+    void beginLifetime(GraphImage image);
+    void addBarriers(const Access& access, BarrierBatch& batch);
+    void recordPass(VkCommandBuffer commandBuffer, Pass& pass, size_t passIdx);
+    bool isReadAfter(GraphImage image, size_t passIdx) const;
+    VkRenderPass getRenderPass(const RenderPassKey& key);
+    VkFramebuffer getFramebuffer(FramebufferKey&& key);
+    bool isUnused(uint64_t lastUsedFrame) const;
+
+    VkDevice device = nullptr;
+    MemoryAllocator* allocator = nullptr;
+    uint32_t framesInFlight = 1;
+    uint64_t frameNumber = 0;
+    uint32_t culledPassCount = 0;
+    TransientMemoryStats transientStats;
+
+    // Declared for the current frame
+    std::vector<Pass> passes;
+    std::vector<ImageResource> images;
+    std::vector<BufferResource> buffers;
+
+    std::vector<TransientHeap> heaps;
+    std::vector<RetiredHeap> retiredHeaps;
+    uint64_t nextHeapId = 1;
+    std::vector<CachedImage> cachedImages;
+    std::map<GraphImageDesc, VkMemoryRequirements> requirements;
+    std::map<RenderPassKey, VkRenderPass> renderPasses;
+    std::unordered_map<FramebufferKey, CachedFramebuffer, FramebufferKeyHash> framebuffers;
+};
+
+} // namespace VaryZulu::Gfx
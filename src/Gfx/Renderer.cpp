@@ -1,18 +1,22 @@
 #include "Renderer.h"
+#include "TextureFormats.h"
+#include "Utils/Trace.h"
 #include "Utils/Utils.h"
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
 #include <cassert>
 #include <vector>
+#include <future>
 #include <optional>
 #include <set>
+#include <thread>
 
 namespace VaryZulu::Gfx
 {
@@ -21,6 +25,69 @@ namespace VaryZulu::Gfx
 #pragma warning(disable : 26812)
 #endif
 
+namespace
+{
+bool hasDeviceExtension(VkPhysicalDevice d, const char* name)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(d, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(d, nullptr, &extensionCount, extensions.data());
+    return std::any_of(extensions.begin(), extensions.end(),
+        [name](const auto& ext) { return std::string{name} == ext.extensionName; });
+}
+
+const char* getDeviceTypeName(VkPhysicalDeviceType type)
+{
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return "discrete GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return "integrated GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return "virtual GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            return "CPU";
+        default:
+            return "other";
+    }
+}
+
+const char* getPresentModeName(VkPresentModeKHR mode)
+{
+    switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR:
+            return "FIFO";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            return "FIFO relaxed";
+        default:
+            return "other";
+    }
+}
+} // namespace
+
+Renderer::Renderer(const Config& initialConfig)
+    : config(initialConfig), framesInFlight(initialConfig.framesInFlight)
+{
+    // Frame pacing waits on a timeline semaphore
+    deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    if (!config.headless) {
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    if (config.instanceCount > MAX_SCENE_INSTANCES) {
+        spdlog::error("At most {} instances are supported", MAX_SCENE_INSTANCES);
+        throw std::runtime_error("Too many instances");
+    }
+    if (framesInFlight == 0 || framesInFlight > MAX_FRAMES_IN_FLIGHT) {
+        spdlog::error("Frames in flight must be between 1 and {}", MAX_FRAMES_IN_FLIGHT);
+        throw std::runtime_error("Invalid frames in flight");
+    }
+}
+
 void Renderer::framebufferResizeCallback(GLFWwindow* window, int, int)
 {
     auto app = reinterpret_cast<Renderer*>(glfwGetWindowUserPointer(window));
@@ -122,15 +189,108 @@ void Renderer::pickPhysicalDevice()
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-    for (const auto& d : devices) {
-        if (isDeviceSuitable(d)) {
-            physicalDevice = d;
-            break;
+    if (config.deviceIndex.has_value()) {
+        auto idx = config.deviceIndex.value();
+        if (idx >= deviceCount) {
+            spdlog::error("Device index {} out of range, {} devices found", idx, deviceCount);
+            throw std::runtime_error("Invalid device index");
+        }
+        if (!isDeviceSuitable(devices[idx])) {
+            throw std::runtime_error("Requested device doesn't meet the requirements");
+        }
+        physicalDevice = devices[idx];
+    } else {
+        uint64_t bestScore = 0;
+        for (const auto& d : devices) {
+            if (!isDeviceSuitable(d)) {
+                continue;
+            }
+            auto score = scoreDevice(d);
+            if (physicalDevice == VK_NULL_HANDLE || score > bestScore) {
+                physicalDevice = d;
+                bestScore = score;
+            }
         }
     }
     if (physicalDevice == VK_NULL_HANDLE) {
         throw std::runtime_error("Failed to select usitable device");
     }
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    reportDeviceCapabilities();
+}
+
+uint64_t Renderer::scoreDevice(VkPhysicalDevice d)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(d, &properties);
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(d, &memProperties);
+
+    // Device type dominates, heap size and limits only break ties within a type
+    uint64_t typeRank = 0;
+    switch (properties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            typeRank = 4;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            typeRank = 3;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            typeRank = 2;
+            break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+            typeRank = 1;
+            break;
+        default:
+            typeRank = 0;
+            break;
+    }
+    uint64_t deviceLocalMb = 0;
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; ++i) {
+        if (memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            deviceLocalMb += memProperties.memoryHeaps[i].size / (1024 * 1024);
+        }
+    }
+    uint64_t score = typeRank * 1'000'000'000ULL;
+    score += deviceLocalMb;
+    score += properties.limits.maxImageDimension2D;
+    spdlog::info("{} scored {}", properties.deviceName, score);
+    return score;
+}
+
+void Renderer::reportDeviceCapabilities()
+{
+    const auto& limits = deviceProperties.limits;
+    spdlog::info("Selected device: {} ({})", deviceProperties.deviceName,
+        getDeviceTypeName(deviceProperties.deviceType));
+    spdlog::info("  API {}.{}.{}, driver 0x{:x}, vendor 0x{:x}, device 0x{:x}",
+        VK_VERSION_MAJOR(deviceProperties.apiVersion),
+        VK_VERSION_MINOR(deviceProperties.apiVersion),
+        VK_VERSION_PATCH(deviceProperties.apiVersion), deviceProperties.driverVersion,
+        deviceProperties.vendorID, deviceProperties.deviceID);
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    for (uint32_t i = 0; i < memProperties.memoryHeapCount; ++i) {
+        const auto& heap = memProperties.memoryHeaps[i];
+        spdlog::info("  Heap {}: {} MB{}", i, heap.size / (1024 * 1024),
+            (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " device local" : "");
+    }
+    spdlog::info("  maxImageDimension2D {}, maxMemoryAllocationCount {}, "
+                 "bufferImageGranularity {}",
+        limits.maxImageDimension2D, limits.maxMemoryAllocationCount,
+        limits.bufferImageGranularity);
+    spdlog::info("  maxUniformBufferRange {}, minUniformBufferOffsetAlignment {}, "
+                 "maxPushConstantsSize {}",
+        limits.maxUniformBufferRange, limits.minUniformBufferOffsetAlignment,
+        limits.maxPushConstantsSize);
+    spdlog::info("  timestampPeriod {} ns, samplerAnisotropy {} (max {})", limits.timestampPeriod,
+        supportedFeatures.samplerAnisotropy == VK_TRUE, limits.maxSamplerAnisotropy);
+    spdlog::info("  multiDrawIndirect {} (max {} draws), drawIndirectFirstInstance {}",
+        supportedFeatures.multiDrawIndirect == VK_TRUE, limits.maxDrawIndirectCount,
+        supportedFeatures.drawIndirectFirstInstance == VK_TRUE);
+    spdlog::info("  textureCompressionBC {}", supportedFeatures.textureCompressionBC == VK_TRUE);
 }
 
 bool Renderer::checkDeviceExtensionSupport(VkPhysicalDevice d)
@@ -155,26 +315,10 @@ bool Renderer::checkDeviceExtensionSupport(VkPhysicalDevice d)
 
 bool Renderer::isDeviceSuitable(VkPhysicalDevice d)
 {
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(d, &deviceProperties);
-    spdlog::info("Evaluating {}", deviceProperties.deviceName);
-
-    if (deviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-        spdlog::info("Not a discrete GPU");
-        return false;
-    }
-
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(d, &deviceFeatures);
-    if (!deviceFeatures.geometryShader) {
-        spdlog::info("Doesn't support geometry shader");
-        return false;
-    }
-
-    if (!deviceFeatures.samplerAnisotropy) {
-        spdlog::info("Anisotropy not supported");
-        return false;
-    }
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(d, &properties);
+    spdlog::info("Evaluating {} ({})", properties.deviceName,
+        getDeviceTypeName(properties.deviceType));
 
     QueueFamilyIndices queueIndices = findQueueFamilies(d);
     if (!queueIndices.isComplete()) {
@@ -187,10 +331,12 @@ bool Renderer::isDeviceSuitable(VkPhysicalDevice d)
         return false;
     }
 
-    SwapChainSupportDetails swapChainDetails = querySwapChainSupport(d);
-    if (swapChainDetails.formats.empty() || swapChainDetails.presentModes.empty()) {
-        spdlog::info("Swap chain inadequate");
-        return false;
+    if (!config.headless) {
+        SwapChainSupportDetails swapChainDetails = querySwapChainSupport(d);
+        if (swapChainDetails.formats.empty() || swapChainDetails.presentModes.empty()) {
+            spdlog::info("Swap chain inadequate");
+            return false;
+        }
     }
 
     spdlog::info("Device matches the requirements");
@@ -202,8 +348,8 @@ void Renderer::createLogicalDevice()
     QueueFamilyIndices queueIndices = findQueueFamilies(physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {
-        queueIndices.graphicsFamily.value(), queueIndices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {queueIndices.graphicsFamily.value(),
+        queueIndices.presentFamily.value(), queueIndices.transferFamily.value()};
 
     spdlog::info("Creating {} {}", uniqueQueueFamilies.size(),
         (uniqueQueueFamilies.size() == 1 ? "queue" : "queues"));
@@ -216,14 +362,34 @@ void Renderer::createLogicalDevice()
                 .pQueuePriorities = &queuePriority});
     }
 
-    VkPhysicalDeviceFeatures deviceFeatures{.samplerAnisotropy = VK_TRUE};
+    // Batches are drawn indirectly when the device allows it, see recordDraws
+    enabledFeatures = VkPhysicalDeviceFeatures{
+        .multiDrawIndirect = supportedFeatures.multiDrawIndirect,
+        .drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance,
+        .samplerAnisotropy = supportedFeatures.samplerAnisotropy,
+        .textureCompressionBC = supportedFeatures.textureCompressionBC};
+
+    // Culled draw commands are written to fixed indices by the GPU, which only works if they can
+    // carry their own firstInstance
+    gpuCulling = config.gpuCulling && supportedFeatures.drawIndirectFirstInstance;
+    bool drawIndirectCount =
+        gpuCulling && supportedFeatures.multiDrawIndirect &&
+        hasDeviceExtension(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (drawIndirectCount) {
+        deviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
 
+    // Required wherever the extension is supported
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+        .timelineSemaphore = VK_TRUE};
     VkDeviceCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &timelineFeatures,
         .queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()),
         .pQueueCreateInfos = queueCreateInfos.data(),
         .enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
         .ppEnabledExtensionNames = deviceExtensions.data(),
-        .pEnabledFeatures = &deviceFeatures};
+        .pEnabledFeatures = &enabledFeatures};
     if (enableValidationLayers) {
         // Deprecated. Backwards compatibility
         createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -235,22 +401,31 @@ void Renderer::createLogicalDevice()
         throw std::runtime_error("Failed creating a logical device");
     }
 
+    if (drawIndirectCount) {
+        cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    spdlog::info("GPU culling {}, draw count {}", gpuCulling ? "on" : "off",
+        cmdDrawIndexedIndirectCount ? "read on the GPU" : "fixed");
+
     vkGetDeviceQueue(device, queueIndices.graphicsFamily.value(), 0, &graphicsQueue);
     vkGetDeviceQueue(device, queueIndices.presentFamily.value(), 0, &presentQueue);
+    vkGetDeviceQueue(device, queueIndices.transferFamily.value(), 0, &transferQueue);
+
+    uploadQueueFamilies = {queueIndices.graphicsFamily.value()};
+    if (queueIndices.transferFamily.value() != queueIndices.graphicsFamily.value()) {
+        uploadQueueFamilies.push_back(queueIndices.transferFamily.value());
+    }
 }
 
-void Renderer::createSwapChain()
+void Renderer::createSwapChain(VkSwapchainKHR oldSwapChain)
 {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-    VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+    presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     swapChainExtent = chooseSwapExtent(swapChainSupport.capabilities);
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
-    if (swapChainSupport.capabilities.maxImageCount > 0 &&
-        imageCount > swapChainSupport.capabilities.maxImageCount) {
-        imageCount = swapChainSupport.capabilities.maxImageCount;
-    }
+    uint32_t imageCount = chooseSwapImageCount(swapChainSupport.capabilities, presentMode);
     VkSwapchainCreateInfoKHR createInfo{.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         .surface = surface,
         .minImageCount = imageCount,
@@ -263,7 +438,7 @@ void Renderer::createSwapChain()
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         .presentMode = presentMode,
         .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE};
+        .oldSwapchain = oldSwapChain};
 
     QueueFamilyIndices queueIndices = findQueueFamilies(physicalDevice);
     uint32_t queueFamilyIndices[] = {
@@ -282,11 +457,31 @@ void Renderer::createSwapChain()
 
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
     swapChainImages.resize(imageCount);
-    spdlog::info("Retrieving {} swapchain images", imageCount);
+    spdlog::info("Retrieving {} swapchain images, {} present mode for the {} policy", imageCount,
+        getPresentModeName(presentMode), getPresentPolicyName(config.presentPolicy));
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
     swapChainImageFormat = surfaceFormat.format;
 }
 
+void Renderer::createOffscreenTargets()
+{
+    swapChainExtent = VkExtent2D{.width = config.width, .height = config.height};
+    swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    // One more target than frames in flight so the CPU never waits on an image still being drawn
+    size_t imageCount = static_cast<size_t>(framesInFlight) + 1;
+    swapChainImages.resize(imageCount);
+    offscreenImagesMemory.resize(imageCount);
+    spdlog::info("Creating {} offscreen {}x{} render targets", imageCount, swapChainExtent.width,
+        swapChainExtent.height);
+    for (size_t i = 0; i < imageCount; ++i) {
+        createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImagesMemory[i]);
+    }
+    nextOffscreenImage = 0;
+}
+
 void Renderer::createImageViews()
 {
     for (const auto& image : swapChainImages) {
@@ -297,46 +492,32 @@ void Renderer::createImageViews()
 
 void Renderer::createRenderPass()
 {
-    VkAttachmentDescription colorAttachment{.format = swapChainImageFormat,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
-
-    VkAttachmentReference colorAttachmentRef{
-        .attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
-
-    VkSubpassDescription subpass{.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &colorAttachmentRef};
-
-    VkSubpassDependency dependency{.srcSubpass = VK_SUBPASS_EXTERNAL,
-        .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT};
-
-    VkRenderPassCreateInfo renderPassInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments = &colorAttachment,
-        .subpassCount = 1,
-        .pSubpasses = &subpass,
-        .dependencyCount = 1,
-        .pDependencies = &dependency};
-    auto res = vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed creating a render pass");
+    // Pipelines and secondary command buffers only need a compatible render pass. The render
+    // graph creates the ones frames actually begin, with barriers instead of dependencies
+    std::array colorFormats{swapChainImageFormat};
+    renderPass = renderGraph.getCompatibleRenderPass(colorFormats, depthFormat);
+}
+
+VkFormat Renderer::findDepthFormat()
+{
+    // Every device supports D16 and at least one of X8D24 and D32F as depth attachments
+    constexpr std::array candidates{VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D16_UNORM};
+    for (auto format : candidates) {
+        VkFormatProperties properties{};
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            spdlog::info("Depth format: {}", getFormatName(format));
+            return format;
+        }
     }
+    throw std::runtime_error("No supported depth format");
 }
 
 void Renderer::createDescriptorSetLayout()
 {
     VkDescriptorSetLayoutBinding uboLayoutBinding{.binding = 0,
-        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
         .descriptorCount = 1,
         .stageFlags = VK_SHADER_STAGE_VERTEX_BIT};
 
@@ -359,11 +540,41 @@ void Renderer::createDescriptorSetLayout()
 
 void Renderer::createGraphicsPipeline()
 {
-    auto vertShaderCode = Utils::readFile("shaders/shader.vert.spv");
-    auto fragShaderCode = Utils::readFile("shaders/shader.frag.spv");
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptorSetLayout};
+    auto res = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    auto pipelines = buildScenePipelines(pipelineCache.get());
+    graphicsPipeline = pipelines.main;
+    depthPrepassPipeline = pipelines.depthPrepass;
+}
+
+ScenePipelines Renderer::buildScenePipelines(VkPipelineCache cache)
+{
+    ScenePipelines pipelines{.main = buildGraphicsPipeline(cache)};
+    if (config.depthPrepass) {
+        try {
+            pipelines.depthPrepass = buildGraphicsPipeline(cache, true);
+        } catch (...) {
+            vkDestroyPipeline(device, pipelines.main, nullptr);
+            throw;
+        }
+    }
+    return pipelines;
+}
 
-    auto vertShaderModule = createShaderModule(vertShaderCode);
-    auto fragShaderModule = createShaderModule(fragShaderCode);
+VkPipeline Renderer::buildGraphicsPipeline(VkPipelineCache cache, bool depthOnly)
+{
+    auto vertShaderModule = loadShaderModule("shaders/shader.vert.spv");
+    VkShaderModule fragShaderModule = nullptr;
+    if (!depthOnly) {
+        fragShaderModule = loadShaderModule("shaders/shader.frag.spv");
+    }
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {
         VkPipelineShaderStageCreateInfo{
@@ -377,12 +588,19 @@ void Renderer::createGraphicsPipeline()
             .module = fragShaderModule,
             .pName = "main"}};
 
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    std::array bindingDescriptions{
+        Vertex::getBindingDescription(), InstanceData::getBindingDescription()};
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+    for (const auto& attribute : Vertex::getAttributeDescriptions()) {
+        attributeDescriptions.push_back(attribute);
+    }
+    for (const auto& attribute : InstanceData::getAttributeDescriptions()) {
+        attributeDescriptions.push_back(attribute);
+    }
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .vertexBindingDescriptionCount = 1,
-        .pVertexBindingDescriptions = &bindingDescription,
+        .vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size()),
+        .pVertexBindingDescriptions = bindingDescriptions.data(),
         .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size()),
         .pVertexAttributeDescriptions = attributeDescriptions.data()};
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{
@@ -390,19 +608,16 @@ void Renderer::createGraphicsPipeline()
         .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
         .primitiveRestartEnable = VK_FALSE};
 
-    VkViewport viewport{.x = 0,
-        .y = 0,
-        .width = static_cast<float>(swapChainExtent.width),
-        .height = static_cast<float>(swapChainExtent.height),
-        .minDepth = 0,
-        .maxDepth = 1.0f};
-    VkRect2D scissor{.offset = {0, 0}, .extent = swapChainExtent};
+    // Viewport and scissor are set while recording, so the pipeline survives a resize
     VkPipelineViewportStateCreateInfo viewportState{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .viewportCount = 1,
-        .pViewports = &viewport,
-        .scissorCount = 1,
-        .pScissors = &scissor};
+        .scissorCount = 1};
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = 2,
+        .pDynamicStates = dynamicStates};
 
     VkPipelineRasterizationStateCreateInfo rasterizer{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
@@ -420,9 +635,22 @@ void Renderer::createGraphicsPipeline()
         .sampleShadingEnable = VK_FALSE,
         .minSampleShading = 1.0f};
 
+    // After a pre-pass the depth buffer already holds the nearest surface, so only fragments
+    // exactly on it are shaded
+    bool afterPrepass = config.depthPrepass && !depthOnly;
+    VkPipelineDepthStencilStateCreateInfo depthStencil{
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = afterPrepass ? VK_FALSE : VK_TRUE,
+        .depthCompareOp = afterPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE};
+
+    // The pre-pass keeps the color attachment of the render pass but never writes it
     VkPipelineColorBlendAttachmentState colorBlendAttachment{.blendEnable = VK_FALSE,
-        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT};
+        .colorWriteMask = depthOnly ? 0u
+                                    : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT};
     VkPipelineColorBlendStateCreateInfo colorBlending{
         .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
         .logicOpEnable = VK_FALSE,
@@ -430,45 +658,55 @@ void Renderer::createGraphicsPipeline()
         .pAttachments = &colorBlendAttachment,
     };
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo{
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 1,
-        .pSetLayouts = &descriptorSetLayout};
-    auto res = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create pipeline layout");
-    }
-
     VkGraphicsPipelineCreateInfo pipelineInfo{
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = 2,
+        .stageCount = depthOnly ? 1u : 2u,
         .pStages = shaderStages,
         .pVertexInputState = &vertexInputInfo,
         .pInputAssemblyState = &inputAssembly,
         .pViewportState = &viewportState,
         .pRasterizationState = &rasterizer,
         .pMultisampleState = &multisampling,
-        .pDepthStencilState = nullptr,
+        .pDepthStencilState = &depthStencil,
         .pColorBlendState = &colorBlending,
-        .pDynamicState = nullptr,
+        .pDynamicState = &dynamicState,
         .layout = pipelineLayout,
         .renderPass = renderPass,
         .subpass = 0,
         .basePipelineHandle = VK_NULL_HANDLE,
         .basePipelineIndex = -1};
 
-    res = vkCreateGraphicsPipelines(
-        device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline);
+    VkPipeline pipeline = nullptr;
+    auto res = vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+    if (fragShaderModule) {
+        vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    }
+    vkDestroyShaderModule(device, vertShaderModule, nullptr);
     if (res != VK_SUCCESS) {
         throw std::runtime_error("Failed to create pipeline");
     }
+    return pipeline;
+}
 
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
+VkShaderModule Renderer::loadShaderModule(const std::string& path)
+{
+    // Reloaded shaders are only written to their files
+    if (assetPack && !config.watchShaders) {
+        if (const auto* entry = assetPack->find(path, Assets::AssetType::Shader)) {
+            return createShaderModule(assetPack->getData(*entry));
+        }
+    }
+    auto file = Utils::readFile(path);
+    return createShaderModule(file.getData());
 }
 
-VkShaderModule Renderer::createShaderModule(const std::vector<char>& code)
+VkShaderModule Renderer::createShaderModule(std::span<const std::byte> code)
 {
+    // Mapped and pack data is page or pack aligned, anything else would be a bug
+    if (code.size() % sizeof(uint32_t) != 0 ||
+        reinterpret_cast<uintptr_t>(code.data()) % alignof(uint32_t) != 0) {
+        throw std::runtime_error("SPIR-V code is not made of aligned 32-bit words");
+    }
     VkShaderModuleCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
         .codeSize = code.size(),
         .pCode = reinterpret_cast<const uint32_t*>(code.data())};
@@ -481,43 +719,17 @@ VkShaderModule Renderer::createShaderModule(const std::vector<char>& code)
     return module;
 }
 
-void Renderer::createFrameBuffers()
-{
-    for (const auto& imageView : swapChainImageViews) {
-        VkImageView attachments[] = {imageView};
-        VkFramebufferCreateInfo frameBufferInfo = {
-            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-            .renderPass = renderPass,
-            .attachmentCount = 1,
-            .pAttachments = attachments,
-            .width = swapChainExtent.width,
-            .height = swapChainExtent.height,
-            .layers = 1};
-
-        VkFramebuffer buf = nullptr;
-        auto res = vkCreateFramebuffer(device, &frameBufferInfo, nullptr, &buf);
-        if (res != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create a frame buffer");
-        }
-        swapChainFramebuffers.push_back(buf);
-    }
-}
-
-void Renderer::createCommandPool()
+void Renderer::createUploadManager()
 {
     QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-    VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value()};
-
-    auto res = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create command pool");
-    }
+    auto family = queueFamilyIndices.transferFamily.value();
+    uploads.init(device, allocator, family, transferQueue,
+        family == queueFamilyIndices.graphicsFamily.value(), STAGING_RING_SIZE);
 }
 
 void Renderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
     VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image,
-    VkDeviceMemory& imageMemory)
+    Allocation& imageMemory)
 {
     VkImageCreateInfo imageInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         .imageType = VK_IMAGE_TYPE_2D,
@@ -532,6 +744,12 @@ void Renderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkI
         .usage = usage,
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    if ((usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && uploadQueueFamilies.size() > 1) {
+        // Written on the transfer queue, read on the graphics queue
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(uploadQueueFamilies.size());
+        imageInfo.pQueueFamilyIndices = uploadQueueFamilies.data();
+    }
     auto res = vkCreateImage(device, &imageInfo, nullptr, &image);
     if (res != VK_SUCCESS) {
         throw std::runtime_error("Failed to create texture image");
@@ -539,63 +757,19 @@ void Renderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkI
 
     VkMemoryRequirements memrequirements{};
     vkGetImageMemoryRequirements(device, image, &memrequirements);
-    VkMemoryAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memrequirements.size,
-        .memoryTypeIndex = findMemoryType(memrequirements.memoryTypeBits, properties)};
-    res = vkAllocateMemory(device, &allocInfo, nullptr, &textureImageMemory);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate texture image memory");
-    }
-    vkBindImageMemory(device, image, imageMemory, 0);
-}
-
-void Renderer::createTextureImage()
-{
-    int texWidth = 0;
-    int texHeight = 0;
-    int tedxChannels = 0;
-    auto pixels =
-        stbi_load("textures/texture.jpg", &texWidth, &texHeight, &tedxChannels, STBI_rgb_alpha);
-    if (!pixels) {
-        throw std::runtime_error("Failed to load texture");
-    }
-    VkDeviceSize imageSize =
-        static_cast<VkDeviceSize>(texWidth) * static_cast<VkDeviceSize>(texHeight) * 4LL;
-    VkBuffer stagingBuffer = nullptr;
-    VkDeviceMemory stagingBufferMemory = nullptr;
-    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-        stagingBufferMemory);
-    void* data = nullptr;
-    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-    vkUnmapMemory(device, stagingBufferMemory);
-    stbi_image_free(pixels);
-
-    createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
-    auto commandBuffer = beginSingleTimeCommands();
-    transitionImageLayout(commandBuffer, textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage(commandBuffer, stagingBuffer, textureImage, static_cast<uint32_t>(texWidth),
-        static_cast<uint32_t>(texHeight));
-    transitionImageLayout(commandBuffer, textureImage, VK_FORMAT_R8G8B8A8_SRGB,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    endSingleTimeCommands(commandBuffer);
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
-
-VkImageView Renderer::createImageView(VkImage image, VkFormat format)
+    imageMemory = allocator.allocate(memrequirements, properties,
+        tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear);
+    vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
+}
+
+VkImageView Renderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect)
 {
     VkImageView imageView = nullptr;
     VkImageViewCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
         .image = image,
         .viewType = VK_IMAGE_VIEW_TYPE_2D,
         .format = format,
-        .subresourceRange = VkImageSubresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .subresourceRange = VkImageSubresourceRange{.aspectMask = aspect,
             .baseMipLevel = 0,
             .levelCount = 1,
             .baseArrayLayer = 0,
@@ -607,16 +781,31 @@ VkImageView Renderer::createImageView(VkImage image, VkFormat format)
     return imageView;
 }
 
-void Renderer::createTextureImageView()
+void Renderer::createTextures()
 {
-    textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB);
+    // Decoding competes with the recording threads only during loading
+    auto cores = std::thread::hardware_concurrency();
+    textures.init(physicalDevice, device, allocator, uploads, uploadQueueFamilies,
+        std::clamp<size_t>(cores / 2, 1, 4), enabledFeatures.textureCompressionBC == VK_TRUE);
+    // Packed textures are already in their final format, they skip the decode workers
+    const auto* packed =
+        assetPack ? assetPack->find(config.texturePath, Assets::AssetType::Texture) : nullptr;
+    if (packed) {
+        demoTexture = textures.create(config.texturePath, static_cast<VkFormat>(packed->info[0]),
+            packed->info[1], packed->info[2], packed->info[3], assetPack->getData(*packed));
+    } else {
+        demoTexture = textures.load(config.texturePath);
+    }
 }
 
 void Renderer::createTextureSampler()
 {
-    VkPhysicalDeviceProperties properties;
-    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    textureSampler = createSampler(VK_LOD_CLAMP_NONE);
+}
 
+VkSampler Renderer::createSampler(float maxLod)
+{
+    bool anisotropy = supportedFeatures.samplerAnisotropy == VK_TRUE;
     VkSamplerCreateInfo samplerInfo{.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
         .magFilter = VK_FILTER_LINEAR,
         .minFilter = VK_FILTER_LINEAR,
@@ -625,74 +814,278 @@ void Renderer::createTextureSampler()
         .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
         .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
         .mipLodBias = 0.0f,
-        .anisotropyEnable = VK_TRUE,
-        .maxAnisotropy = properties.limits.maxSamplerAnisotropy,
+        .anisotropyEnable = anisotropy ? VK_TRUE : VK_FALSE,
+        .maxAnisotropy = anisotropy ? deviceProperties.limits.maxSamplerAnisotropy : 1.0f,
         .compareEnable = VK_FALSE,
         .compareOp = VK_COMPARE_OP_ALWAYS,
         .minLod = 0.0f,
-        .maxLod = 0.0f,
+        .maxLod = maxLod,
         .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
         .unnormalizedCoordinates = VK_FALSE};
 
-    auto res = vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler);
+    VkSampler sampler = nullptr;
+    auto res = vkCreateSampler(device, &samplerInfo, nullptr, &sampler);
     if (res != VK_SUCCESS) {
         throw std::runtime_error("Failed to create texture sampler");
     }
+    return sampler;
 }
 
-void Renderer::createCommandBuffers()
+void Renderer::createFrameCommands()
 {
-    commandBuffers.resize(swapChainFramebuffers.size());
-    VkCommandBufferAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = static_cast<uint32_t>(commandBuffers.size())};
-    auto res = vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data());
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate command buffers");
+    auto threadCount = config.recordThreads;
+    if (threadCount == 0) {
+        // Leave one core to the render thread, which waits on the workers anyway
+        auto cores = std::thread::hardware_concurrency();
+        threadCount = std::clamp<uint32_t>(cores > 1 ? cores - 1 : 1, 1, 8);
     }
+    recordThreads = std::make_unique<Utils::ThreadPool>(threadCount);
+    spdlog::info("Recording secondary command buffers on up to {} threads", threadCount);
 
-    size_t i = 0;
-    for (auto& buf : commandBuffers) {
-        VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-        res = vkBeginCommandBuffer(buf, &beginInfo);
+    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queueFamilyIndices.graphicsFamily.value()};
+    auto makePool = [&]() {
+        VkCommandPool pool = nullptr;
+        auto res = vkCreateCommandPool(device, &poolInfo, nullptr, &pool);
         if (res != VK_SUCCESS) {
-            throw std::runtime_error("Failed to begin recording command buffer");
+            throw std::runtime_error("Failed to create command pool");
         }
-
-        VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-        VkRenderPassBeginInfo renderPassInfo{.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            .renderPass = renderPass,
-            .framebuffer = swapChainFramebuffers[i],
-            .renderArea = VkRect2D{.offset = {0, 0}, .extent = swapChainExtent},
-            .clearValueCount = 1,
-            .pClearValues = &clearColor};
-        vkCmdBeginRenderPass(buf, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(buf, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(buf, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-            0, 1, &descriptorSets[i], 0, nullptr);
-        vkCmdDrawIndexed(buf, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-        vkCmdEndRenderPass(buf);
-        res = vkEndCommandBuffer(buf);
+        return pool;
+    };
+    auto allocateBuffer = [&](VkCommandPool pool, VkCommandBufferLevel level) {
+        VkCommandBufferAllocateInfo allocInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = pool,
+            .level = level,
+            .commandBufferCount = 1};
+        VkCommandBuffer buf = nullptr;
+        auto res = vkAllocateCommandBuffers(device, &allocInfo, &buf);
         if (res != VK_SUCCESS) {
-            throw std::runtime_error("Failed recording command buffer");
+            throw std::runtime_error("Failed to allocate command buffers");
+        }
+        return buf;
+    };
+
+    frameCommands.resize(framesInFlight);
+    for (auto& frame : frameCommands) {
+        frame.primaryPool = makePool();
+        frame.primary = allocateBuffer(frame.primaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            frame.threadPools.push_back(makePool());
+            frame.secondaries.push_back(
+                allocateBuffer(frame.threadPools.back(), VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+            if (config.depthPrepass) {
+                frame.prepassSecondaries.push_back(
+                    allocateBuffer(frame.threadPools.back(), VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+            }
+        }
+    }
+}
+
+void Renderer::destroyFrameCommands()
+{
+    recordThreads.reset();
+    for (auto& frame : frameCommands) {
+        vkDestroyCommandPool(device, frame.primaryPool, nullptr);
+        std::for_each(frame.threadPools.begin(), frame.threadPools.end(),
+            [this](auto& pool) { vkDestroyCommandPool(device, pool, nullptr); });
+        frame = FrameCommands{};
+    }
+}
+
+void Renderer::recordCommandBuffer(FrameCommands& frame, uint32_t imageIdx)
+{
+    vkResetCommandPool(device, frame.primaryPool, 0);
+    VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    auto res = vkBeginCommandBuffer(frame.primary, &beginInfo);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer");
+    }
+
+    auto slot = static_cast<uint32_t>(currentFrame);
+    profiler.resetGpuScopes(frame.primary, slot);
+    profiler.beginGpuScope(frame.primary, slot, "Frame");
+
+    renderGraph.beginFrame(frameNumber);
+    // The submit waits for the acquired image at the color output stage
+    auto color = renderGraph.importImage(swapChainImages[imageIdx], swapChainImageViews[imageIdx],
+        GraphImageDesc{.format = swapChainImageFormat,
+            .width = swapChainExtent.width,
+            .height = swapChainExtent.height,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    auto depth = renderGraph.createImage(GraphImageDesc{.format = depthFormat,
+        .width = swapChainExtent.width,
+        .height = swapChainExtent.height,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        .aspect = VK_IMAGE_ASPECT_DEPTH_BIT});
+
+    GraphBuffer culledInstances = 0;
+    GraphBuffer drawCommands = 0;
+    GraphBuffer counters = 0;
+    if (gpuCulling) {
+        culledInstances = renderGraph.importBuffer(culler.getCulledInstances(slot));
+        drawCommands = renderGraph.importBuffer(culler.getDrawCommands(slot));
+        counters = renderGraph.importBuffer(culler.getCounters(slot));
+        constexpr auto stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        renderGraph
+            .addPass("Cull",
+                [&](const PassContext& context) {
+                    culler.record(context.commandBuffer, slot, frameViewProj,
+                        static_cast<uint32_t>(scene.getInstanceCount()),
+                        static_cast<uint32_t>(scene.getBatches().size()));
+                })
+            .writeBuffer(culledInstances, stage, VK_ACCESS_SHADER_WRITE_BIT)
+            .writeBuffer(drawCommands, stage, VK_ACCESS_SHADER_WRITE_BIT)
+            .writeBuffer(counters, stage, VK_ACCESS_SHADER_WRITE_BIT);
+    }
+    auto mainPass =
+        renderGraph
+            .addPass("Main pass",
+                [&](const PassContext& context) { recordMainPass(frame, context); })
+            .colorAttachment(
+                color, AttachmentLoad::Clear, VkClearColorValue{{0.0f, 0.0f, 0.0f, 1.0f}})
+            .depthAttachment(depth, AttachmentLoad::Clear)
+            .secondaryCommandBuffers();
+    if (gpuCulling) {
+        mainPass.readBuffer(culledInstances, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        if (enabledFeatures.drawIndirectFirstInstance) {
+            mainPass.readBuffer(drawCommands, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+            if (cmdDrawIndexedIndirectCount) {
+                mainPass.readBuffer(counters, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                    VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+            }
+        }
+    }
+    renderGraph.execute(frame.primary, profiler, slot);
+
+    profiler.endGpuScope(frame.primary, slot);
+    res = vkEndCommandBuffer(frame.primary);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed recording command buffer");
+    }
+}
+
+void Renderer::recordMainPass(FrameCommands& frame, const PassContext& context)
+{
+    // Split draws into contiguous ranges, one per thread, but only as many threads as the
+    // draw count pays for. A GPU-side draw count can't be split
+    auto drawCount = cmdDrawIndexedIndirectCount ? 1 : scene.getBatches().size();
+    auto threadCount =
+        std::clamp<size_t>(drawCount / MIN_DRAWS_PER_THREAD, 1, frame.secondaries.size());
+    auto drawsPerThread = (drawCount + threadCount - 1) / threadCount;
+    VkCommandBufferInheritanceInfo inheritanceInfo{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = context.renderPass,
+        .subpass = 0,
+        .framebuffer = context.framebuffer};
+    auto recordSecondary = [&](size_t thread) {
+        if (thread >= threadCount) {
+            return;
+        }
+        vkResetCommandPool(device, frame.threadPools[thread], 0);
+        VkCommandBufferBeginInfo secondaryBeginInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                     VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = &inheritanceInfo};
+        VZ_TRACE_SCOPE("Record secondary");
+        auto firstDraw = std::min(drawCount, thread * drawsPerThread);
+        auto lastDraw = std::min(drawCount, firstDraw + drawsPerThread);
+        auto record = [&](VkCommandBuffer buf, VkPipeline pipeline) {
+            if (vkBeginCommandBuffer(buf, &secondaryBeginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to begin recording secondary command buffer");
+            }
+            recordDraws(buf, pipeline, firstDraw, lastDraw);
+            if (vkEndCommandBuffer(buf) != VK_SUCCESS) {
+                throw std::runtime_error("Failed recording secondary command buffer");
+            }
+        };
+        if (config.depthPrepass) {
+            record(frame.prepassSecondaries[thread], depthPrepassPipeline);
+        }
+        record(frame.secondaries[thread], graphicsPipeline);
+    };
+    if (threadCount == 1) {
+        recordSecondary(0);
+    } else {
+        recordThreads->dispatch(recordSecondary);
+    }
+    // Every pre-pass draw goes first, so the depth buffer is complete before anything is shaded.
+    // Draws within a subpass are ordered, no barrier is needed in between
+    if (config.depthPrepass) {
+        vkCmdExecuteCommands(context.commandBuffer, static_cast<uint32_t>(threadCount),
+            frame.prepassSecondaries.data());
+    }
+    vkCmdExecuteCommands(
+        context.commandBuffer, static_cast<uint32_t>(threadCount), frame.secondaries.data());
+}
+
+void Renderer::recordDraws(
+    VkCommandBuffer commandBuffer, VkPipeline pipeline, size_t firstBatch, size_t lastBatch)
+{
+    if (firstBatch == lastBatch) {
+        return;
+    }
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    // Dynamic state is not inherited by secondary command buffers
+    VkViewport viewport{.x = 0,
+        .y = 0,
+        .width = static_cast<float>(swapChainExtent.width),
+        .height = static_cast<float>(swapChainExtent.height),
+        .minDepth = 0,
+        .maxDepth = 1.0f};
+    VkRect2D scissor{.offset = {0, 0}, .extent = swapChainExtent};
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    meshes.bind(commandBuffer);
+    // With GPU culling only the instances that survived are drawn
+    auto frame = static_cast<uint32_t>(currentFrame);
+    auto instanceBuffer =
+        gpuCulling ? culler.getCulledInstances(frame) : sceneBuffers[currentFrame].instances;
+    VkDeviceSize instanceOffset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffer, &instanceOffset);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+        &descriptorSets[currentFrame], 1, &frameUniformOffset);
+
+    const auto& batches = scene.getBatches();
+    if (!enabledFeatures.drawIndirectFirstInstance) {
+        // Indirect commands would have to start at instance 0, direct draws don't
+        for (auto i = firstBatch; i < lastBatch; ++i) {
+            const auto& mesh = meshes.get(batches[i].mesh);
+            vkCmdDrawIndexed(commandBuffer, mesh.indexCount, batches[i].instanceCount,
+                mesh.firstIndex, mesh.vertexOffset, batches[i].firstInstance);
+        }
+        return;
+    }
+    auto drawCommands =
+        gpuCulling ? culler.getDrawCommands(frame) : sceneBuffers[currentFrame].drawCommands;
+    constexpr auto stride = static_cast<uint32_t>(sizeof(VkDrawIndexedIndirectCommand));
+    if (cmdDrawIndexedIndirectCount) {
+        cmdDrawIndexedIndirectCount(commandBuffer, drawCommands, 0, culler.getCounters(frame), 0,
+            static_cast<uint32_t>(batches.size()), stride);
+    } else if (enabledFeatures.multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, firstBatch * stride,
+            static_cast<uint32_t>(lastBatch - firstBatch), stride);
+    } else {
+        for (auto i = firstBatch; i < lastBatch; ++i) {
+            vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, i * stride, 1, stride);
         }
-        ++i;
     }
 }
 
 void Renderer::createSyncObjects()
 {
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightImages.resize(swapChainImages.size(), VK_NULL_HANDLE);
+    framePacer.init(device, framesInFlight, config.latencyLimit);
+    applyPresentPolicy();
+    imageAvailableSemaphores.resize(framesInFlight);
+    renderFinishedSemaphores.resize(framesInFlight);
     VkSemaphoreCreateInfo createInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
 
     auto makeSem = [&](VkSemaphore& s) {
@@ -709,107 +1102,444 @@ void Renderer::createSyncObjects()
 
     std::for_each(renderFinishedSemaphores.begin(), renderFinishedSemaphores.end(),
         [&](auto& s) { makeSem(s); });
-
-    VkFenceCreateInfo fenceInfo{
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .flags = VK_FENCE_CREATE_SIGNALED_BIT};
-    std::for_each(inFlightFences.begin(), inFlightFences.end(), [&](auto& f) {
-        VkFence newFence = nullptr;
-        auto res = vkCreateFence(device, &fenceInfo, nullptr, &newFence);
-        if (res != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create fence");
-        }
-        f = newFence;
-    });
 }
 
 void Renderer::mainLoop()
 {
-    int64_t lastTimeMs = Utils::GetCurrentTimeMs();
-    int64_t frames = 0;
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
-        if (!drawFrame()) {
+    // Startup assets have to be resident before the first frame samples them
+    uploads.wait(sceneUploads);
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto lastStatsTime = startTime;
+    uint64_t totalFrames = 0;
+    while (config.headless || !glfwWindowShouldClose(window)) {
+        if (config.frameLimit > 0 && totalFrames >= config.frameLimit) {
             break;
         }
-        ++frames;
-        auto timeMs = Utils::GetCurrentTimeMs();
-        if (timeMs - lastTimeMs > 1000) {
-            spdlog::debug("{} FPS", frames);
-            frames = 0;
-            lastTimeMs = timeMs;
+        profiler.beginFrame();
+        if (!config.headless) {
+            Profiler::Scope scope(profiler, "Poll events");
+            glfwPollEvents();
+        }
+        bool drawn = drawFrame();
+        profiler.endFrame();
+        if (!drawn) {
+            break;
+        }
+        ++totalFrames;
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastStatsTime > std::chrono::seconds(1)) {
+            profiler.logStats(spdlog::level::debug);
+            logMemoryStats();
+            logPacingStats();
+            // Keeps the per-thread trace buffers from growing over a long session
+            Utils::Trace::flush();
+            lastStatsTime = now;
         }
     }
     vkDeviceWaitIdle(device);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - startTime;
+    if (elapsed.count() > 0.0) {
+        spdlog::info("Rendered {} frames in {:.0f} ms ({:.1f} FPS)", totalFrames, elapsed.count(),
+            static_cast<double>(totalFrames) * 1000.0 / elapsed.count());
+    }
+    // Frames still in flight at the loop exit are done now
+    framePacer.poll();
+    for (uint32_t slot = 0; slot < framesInFlight; ++slot) {
+        profiler.collectGpuResults(slot);
+    }
+    profiler.logStats(spdlog::level::info);
+    if (!config.profileTracePath.empty()) {
+        profiler.writeChromeTrace(config.profileTracePath);
+    }
+}
+
+void Renderer::runStartupBenchmark()
+{
+    constexpr int iterations = 10;
+    auto timeBuild = [this](VkPipelineCache cache) {
+        auto start = std::chrono::steady_clock::now();
+        auto pipeline = buildGraphicsPipeline(cache);
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        vkDestroyPipeline(device, pipeline, nullptr);
+        return elapsed.count();
+    };
+    auto median = [](std::vector<double>& times) {
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    };
+
+    std::vector<double> coldTimes;
+    std::vector<double> warmTimes;
+    for (int i = 0; i < iterations; ++i) {
+        // A fresh cache every time, otherwise only the first cold build would be cold
+        VkPipelineCacheCreateInfo emptyInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+        VkPipelineCache emptyCache = nullptr;
+        if (vkCreatePipelineCache(device, &emptyInfo, nullptr, &emptyCache) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline cache");
+        }
+        coldTimes.push_back(timeBuild(emptyCache));
+        vkDestroyPipelineCache(device, emptyCache, nullptr);
+        warmTimes.push_back(timeBuild(pipelineCache.get()));
+    }
+    // Drivers may keep their own shader cache, which makes cold builds look faster than on a
+    // first launch
+    spdlog::info("Graphics pipeline build, median of {}: cold {:.3f} ms, warm {:.3f} ms",
+        iterations, median(coldTimes), median(warmTimes));
+}
+
+void Renderer::runInstanceBenchmark()
+{
+    uploads.wait(sceneUploads);
+
+    constexpr uint64_t warmupFrames = 30;
+    auto measuredFrames = config.frameLimit > 0 ? config.frameLimit : 300;
+    const std::array<uint32_t, 9> instanceCounts{
+        1, 10, 100, 1000, 5000, 10000, 25000, 50000, 100000};
+    std::vector<std::pair<uint32_t, double>> results;
+    for (auto count : instanceCounts) {
+        config.instanceCount = std::min(count, MAX_SCENE_INSTANCES);
+        std::chrono::steady_clock::time_point measureStart;
+        for (uint64_t i = 0; i < warmupFrames + measuredFrames; ++i) {
+            if (i == warmupFrames) {
+                // Start timing with an empty queue so warm-up frames don't leak into the result
+                vkDeviceWaitIdle(device);
+                measureStart = std::chrono::steady_clock::now();
+            }
+            if (!config.headless) {
+                glfwPollEvents();
+                if (glfwWindowShouldClose(window)) {
+                    vkDeviceWaitIdle(device);
+                    return;
+                }
+            }
+            profiler.beginFrame();
+            bool drawn = drawFrame();
+            profiler.endFrame();
+            if (!drawn) {
+                vkDeviceWaitIdle(device);
+                return;
+            }
+        }
+        vkDeviceWaitIdle(device);
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - measureStart;
+        auto frameMs = elapsed.count() / static_cast<double>(measuredFrames);
+        spdlog::info("{:>6} instances: {:.3f} ms per frame ({:.1f} FPS)", count, frameMs,
+            1000.0 / frameMs);
+        results.emplace_back(count, frameMs);
+    }
+    spdlog::info("instances,ms_per_frame");
+    for (const auto& [count, frameMs] : results) {
+        spdlog::info("{},{:.4f}", count, frameMs);
+    }
+}
+
+void Renderer::runMipBenchmark()
+{
+    uploads.wait(sceneUploads);
+
+    // A dense grid shrinks every quad to a few pixels, where sampling level 0 thrashes the
+    // texture cache and the mip chain reads only a coarse level
+    constexpr uint32_t minInstances = 10000;
+    if (config.instanceCount < minInstances) {
+        config.instanceCount = std::min(minInstances, MAX_SCENE_INSTANCES);
+    }
+    auto renderFrames = [this](uint64_t count) {
+        for (uint64_t i = 0; i < count; ++i) {
+            if (!config.headless) {
+                glfwPollEvents();
+                if (glfwWindowShouldClose(window)) {
+                    return false;
+                }
+            }
+            profiler.beginFrame();
+            bool drawn = drawFrame();
+            profiler.endFrame();
+            if (!drawn) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // The texture has to be resident, or both runs would sample the placeholder
+    while (!textures.isResident(demoTexture) && textures.getPendingCount() > 0) {
+        if (!renderFrames(1)) {
+            vkDeviceWaitIdle(device);
+            return;
+        }
+    }
+    if (!textures.isResident(demoTexture)) {
+        spdlog::error("Texture failed to load, nothing to compare");
+        vkDeviceWaitIdle(device);
+        return;
+    }
+
+    constexpr uint64_t warmupFrames = 30;
+    auto measuredFrames = config.frameLimit > 0 ? config.frameLimit : 300;
+    auto fullChainSampler = textureSampler;
+    auto baseLevelSampler = createSampler(0.0f);
+    std::array<std::pair<const char*, VkSampler>, 2> modes{
+        std::pair{"base level only", baseLevelSampler}, std::pair{"mip chain", fullChainSampler}};
+    std::array<FrameTimeStats, 2> results{};
+    for (size_t mode = 0; mode < modes.size(); ++mode) {
+        // Every frame slot rewrites its descriptor with the new sampler before its next use
+        textureSampler = modes[mode].second;
+        std::fill(descriptorTextureVersions.begin(), descriptorTextureVersions.end(), ~0ull);
+        bool completed = renderFrames(warmupFrames);
+        vkDeviceWaitIdle(device);
+        for (uint32_t slot = 0; slot < framesInFlight; ++slot) {
+            profiler.collectGpuResults(slot);
+        }
+        profiler.resetHistory();
+        completed = completed && renderFrames(measuredFrames);
+        vkDeviceWaitIdle(device);
+        for (uint32_t slot = 0; slot < framesInFlight; ++slot) {
+            profiler.collectGpuResults(slot);
+        }
+        if (!completed) {
+            break;
+        }
+        results[mode] = profiler.getStats();
+        spdlog::info("{} instances, {}: GPU p50 {:.3f} ms, p95 {:.3f} ms, CPU p50 {:.3f} ms",
+            config.instanceCount, modes[mode].first, results[mode].gpuP50, results[mode].gpuP95,
+            results[mode].cpuP50);
+    }
+    textureSampler = fullChainSampler;
+    std::fill(descriptorTextureVersions.begin(), descriptorTextureVersions.end(), ~0ull);
+    vkDestroySampler(device, baseLevelSampler, nullptr);
+
+    if (results[0].gpuFrames > 0 && results[1].gpuFrames > 0) {
+        spdlog::info("Mipmapping changed the GPU p50 frame time by {:+.1f}%",
+            (results[1].gpuP50 / results[0].gpuP50 - 1.0) * 100.0);
+    }
+}
+
+void Renderer::runPresentBenchmark()
+{
+    uploads.wait(sceneUploads);
+    if (config.headless) {
+        spdlog::warn("Offscreen targets aren't presented, only the pacing of the policies differs");
+    }
+
+    constexpr uint64_t warmupFrames = 30;
+    auto measuredFrames = config.frameLimit > 0 ? config.frameLimit : 300;
+    struct PolicyResult
+    {
+        PresentPolicy policy = PresentPolicy::Throughput;
+        VkPresentModeKHR mode = VK_PRESENT_MODE_FIFO_KHR;
+        size_t imageCount = 0;
+        double frameMs = 0.0;
+        FramePacingStats pacing;
+    };
+    std::vector<PolicyResult> results;
+    for (auto policy :
+        {PresentPolicy::LowLatency, PresentPolicy::PowerSaving, PresentPolicy::Throughput}) {
+        config.presentPolicy = policy;
+        if (!config.headless) {
+            recreateSwapChain();
+        }
+        applyPresentPolicy();
+        std::chrono::steady_clock::time_point measureStart;
+        for (uint64_t i = 0; i < warmupFrames + measuredFrames; ++i) {
+            if (i == warmupFrames) {
+                // Latency is only counted for frames begun from here on
+                vkDeviceWaitIdle(device);
+                framePacer.poll();
+                framePacer.takeStats();
+                measureStart = std::chrono::steady_clock::now();
+            }
+            if (!config.headless) {
+                glfwPollEvents();
+                if (glfwWindowShouldClose(window)) {
+                    vkDeviceWaitIdle(device);
+                    return;
+                }
+            }
+            profiler.beginFrame();
+            bool drawn = drawFrame();
+            profiler.endFrame();
+            if (!drawn) {
+                vkDeviceWaitIdle(device);
+                return;
+            }
+        }
+        vkDeviceWaitIdle(device);
+        framePacer.poll();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - measureStart;
+        PolicyResult result{.policy = policy,
+            .mode = presentMode,
+            .imageCount = swapChainImages.size(),
+            .frameMs = elapsed.count() / static_cast<double>(measuredFrames),
+            .pacing = framePacer.takeStats()};
+        spdlog::info("{:>12}: {:.3f} ms per frame ({:.1f} FPS), latency {:.2f} ms (max {:.2f}), "
+                     "{} images",
+            getPresentPolicyName(policy), result.frameMs, 1000.0 / result.frameMs,
+            result.pacing.latencyMsAvg, result.pacing.latencyMsMax, result.imageCount);
+        results.push_back(result);
+    }
+    spdlog::info("policy,present_mode,images,ms_per_frame,latency_ms,latency_max_ms");
+    for (const auto& result : results) {
+        spdlog::info("{},{},{},{:.4f},{:.4f},{:.4f}", getPresentPolicyName(result.policy),
+            config.headless ? "none" : getPresentModeName(result.mode), result.imageCount,
+            result.frameMs, result.pacing.latencyMsAvg, result.pacing.latencyMsMax);
+    }
 }
 
-void Renderer::updateUniformBuffer(uint32_t currImage)
+void Renderer::updateScene(uint32_t frame)
 {
     static auto startTime = Utils::GetCurrentTimeMs();
     auto timePassed = Utils::GetCurrentTimeMs() - startTime;
+    auto angle = static_cast<float>(timePassed / 1000.0f) * glm::radians(90.0f);
+
+    // Square grid centered on the origin. A single instance sits at the origin
+    auto side = static_cast<uint32_t>(std::ceil(std::sqrt(config.instanceCount)));
+    constexpr float spacing = 1.5f;
+    auto halfExtent = static_cast<float>(side - 1) * spacing * 0.5f;
+    scene.clear();
+    for (uint32_t i = 0; i < config.instanceCount; ++i) {
+        glm::vec3 position{static_cast<float>(i % side) * spacing - halfExtent,
+            static_cast<float>(i / side) * spacing - halfExtent, 0.0f};
+        auto model = glm::rotate(
+            glm::translate(glm::mat4(1.0f), position), angle, glm::vec3(0.0f, 0.0f, 1.0f));
+        // A lone instance keeps the plain texture, a grid gets a color per instance
+        auto hue = static_cast<float>(i);
+        auto color = config.instanceCount == 1
+                         ? glm::vec4(1.0f)
+                         : glm::vec4(0.6f + 0.4f * glm::cos(hue * 0.7f),
+                               0.6f + 0.4f * glm::cos(hue * 1.3f + 2.0f),
+                               0.6f + 0.4f * glm::cos(hue * 2.1f + 4.0f), 1.0f);
+        scene.submit(demoMeshes[i % demoMeshes.size()], model, color);
+    }
+
+    auto& buffers = sceneBuffers[frame];
+    scene.buildBatches(meshes.getMeshCount(),
+        static_cast<InstanceData*>(buffers.instancesMemory.mapped),
+        gpuCulling ? culler.getInstanceBatches(frame) : nullptr);
+    const auto& batches = scene.getBatches();
+    if (batches.size() > MAX_DRAW_BATCHES) {
+        throw std::runtime_error("Too many draw batches");
+    }
+    if (gpuCulling) {
+        // Draw commands are generated by the culling pass
+        auto cullBatches = culler.getBatches(frame);
+        for (const auto& batch : batches) {
+            const auto& mesh = meshes.get(batch.mesh);
+            *cullBatches++ = CullBatch{.indexCount = mesh.indexCount,
+                .firstIndex = mesh.firstIndex,
+                .vertexOffset = mesh.vertexOffset,
+                .firstInstance = batch.firstInstance,
+                .boundingSphere = mesh.boundingSphere};
+        }
+    } else {
+        auto commands =
+            static_cast<VkDrawIndexedIndirectCommand*>(buffers.drawCommandsMemory.mapped);
+        for (const auto& batch : batches) {
+            const auto& mesh = meshes.get(batch.mesh);
+            *commands++ = VkDrawIndexedIndirectCommand{.indexCount = mesh.indexCount,
+                .instanceCount = batch.instanceCount,
+                .firstIndex = mesh.firstIndex,
+                .vertexOffset = mesh.vertexOffset,
+                .firstInstance = batch.firstInstance};
+        }
+    }
+
+    // Pull the camera back as the grid grows
+    auto viewScale = std::max(1.0f, halfExtent + spacing * 0.5f);
     UniformBufferObject ubo;
-    ubo.model =
-        glm::rotate(glm::mat4(1.0f), static_cast<float>(timePassed / 1000.0f) * glm::radians(90.0f),
-            glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(
-        glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f) * viewScale, glm::vec3(0.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f));
     float aspect = swapChainExtent.width / static_cast<float>(swapChainExtent.height);
-    ubo.proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 10.0f);
+    ubo.proj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 10.0f * viewScale);
     ubo.proj[1][1] *= -1;
-    void* data = nullptr;
-    vkMapMemory(device, uniformBuffersMemory[currImage], 0, sizeof(ubo), 0, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vkUnmapMemory(device, uniformBuffersMemory[currImage]);
+    frameViewProj = ubo.proj * ubo.view;
+    uniformRing.beginFrame(frame);
+    frameUniformOffset = uniformRing.push(ubo);
 }
 
 bool Renderer::drawFrame()
 {
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    uint32_t slot = 0;
+    {
+        // The scene is updated after the wait, so the latency limit bounds how old the
+        // animation time is by the time the frame is shown
+        Profiler::Scope scope(profiler, "Wait for frame");
+        slot = framePacer.beginFrame(frameNumber);
+    }
+    currentFrame = slot;
+    profiler.collectGpuResults(slot);
+    uploads.collect();
+    destroyRetiredObjects(false);
+    updateShaders();
+    // The slot's descriptor set is no longer in use once the pacer let the frame begin
+    textures.update();
+    updateTextureDescriptors(slot);
+    // Drawing waits for the acquired image's semaphore, which follows its previous present, so
+    // no per-image fences are needed. Offscreen targets rotate one more than frames in flight
     uint32_t imageIdx = 0;
-    auto res = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
-        imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIdx);
-    if (res != VK_SUCCESS) {
-        if (res == VK_ERROR_OUT_OF_DATE_KHR) {
-            spdlog::info("Swap chain out of date. Recreating");
-            recreateSwapChain();
-            return true;
-        } else if (res != VK_SUBOPTIMAL_KHR) {
-            spdlog::error("Failed to acquire the next image: {}", res);
-            return false;
+    VkResult res = VK_SUCCESS;
+    if (config.headless) {
+        imageIdx = nextOffscreenImage;
+        nextOffscreenImage =
+            (nextOffscreenImage + 1) % static_cast<uint32_t>(swapChainImages.size());
+    } else {
+        Profiler::Scope scope(profiler, "Acquire");
+        res = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
+            imageAvailableSemaphores[slot], VK_NULL_HANDLE, &imageIdx);
+        if (res != VK_SUCCESS) {
+            if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+                spdlog::info("Swap chain out of date. Recreating");
+                recreateSwapChain();
+                return true;
+            } else if (res != VK_SUBOPTIMAL_KHR) {
+                spdlog::error("Failed to acquire the next image: {}", res);
+                return false;
+            }
         }
     }
-    if (inFlightImages[imageIdx] != VK_NULL_HANDLE) {
-        vkWaitForFences(device, 1, &inFlightImages[imageIdx], VK_TRUE, UINT64_MAX);
+    {
+        Profiler::Scope scope(profiler, "Update scene");
+        updateScene(slot);
+    }
+    {
+        Profiler::Scope scope(profiler, "Record");
+        recordCommandBuffer(frameCommands[slot], imageIdx);
+    }
+    // Offscreen targets have nothing to acquire or present, so no binary semaphores are involved
+    auto imageAvailable = config.headless ? VK_NULL_HANDLE : imageAvailableSemaphores[slot];
+    auto renderFinished = config.headless ? VK_NULL_HANDLE : renderFinishedSemaphores[slot];
+    profiler.markSubmit(slot);
+    {
+        Profiler::Scope scope(profiler, "Submit");
+        res = framePacer.submit(graphicsQueue, frameCommands[slot].primary, frameNumber,
+            imageAvailable, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, renderFinished);
     }
-    inFlightImages[imageIdx] = inFlightFences[currentFrame];
-
-    vkResetFences(device, 1, &inFlightFences[currentFrame]);
-    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    updateUniformBuffer(imageIdx);
-    VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = waitSemaphores,
-        .pWaitDstStageMask = waitStages,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &commandBuffers[imageIdx],
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = signalSemaphores};
-    res = vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]);
     if (res != VK_SUCCESS) {
         spdlog::error("Submitting to queue failed");
         return false;
     }
 
+    ++frameNumber;
+    if (config.headless) {
+        return true;
+    }
+
     VkSwapchainKHR swapChains[] = {swapChain};
     VkPresentInfoKHR presentInfo{.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
-        .pWaitSemaphores = signalSemaphores,
+        .pWaitSemaphores = &renderFinished,
         .swapchainCount = 1,
         .pSwapchains = swapChains,
         .pImageIndices = &imageIdx};
 
-    res = vkQueuePresentKHR(presentQueue, &presentInfo);
+    {
+        Profiler::Scope scope(profiler, "Present");
+        res = vkQueuePresentKHR(presentQueue, &presentInfo);
+    }
     if (res != VK_SUCCESS) {
         if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || framebufferResized) {
             spdlog::info("Out of date or suboptimal swap chain: {}. Recreating.", res);
@@ -820,32 +1550,52 @@ bool Renderer::drawFrame()
             return false;
         }
     }
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
     return true;
 }
 
 void Renderer::cleanupSwapChain()
 {
-    std::for_each(uniformBuffers.begin(), uniformBuffers.end(),
-        [this](auto& buf) { vkDestroyBuffer(device, buf, nullptr); });
-    uniformBuffers.clear();
-    std::for_each(uniformBuffersMemory.begin(), uniformBuffersMemory.end(),
-        [this](auto& buf) { vkFreeMemory(device, buf, nullptr); });
-    uniformBuffersMemory.clear();
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-    std::for_each(swapChainFramebuffers.begin(), swapChainFramebuffers.end(),
-        [this](auto& buf) { vkDestroyFramebuffer(device, buf, nullptr); });
-    swapChainFramebuffers.clear();
-    vkFreeCommandBuffers(
-        device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
-    std::for_each(swapChainImageViews.begin(), swapChainImageViews.end(),
-        [&](auto& imageView) { vkDestroyImageView(device, imageView, nullptr); });
+    std::for_each(swapChainImageViews.begin(), swapChainImageViews.end(), [&](auto& imageView) {
+        renderGraph.releaseView(imageView);
+        vkDestroyImageView(device, imageView, nullptr);
+    });
     swapChainImageViews.clear();
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
-    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    if (config.headless) {
+        std::for_each(swapChainImages.begin(), swapChainImages.end(),
+            [this](auto& image) { vkDestroyImage(device, image, nullptr); });
+        std::for_each(offscreenImagesMemory.begin(), offscreenImagesMemory.end(),
+            [this](auto& memory) { allocator.free(memory); });
+        swapChainImages.clear();
+        offscreenImagesMemory.clear();
+    } else {
+        vkDestroySwapchainKHR(device, swapChain, nullptr);
+    }
+    destroyRetiredObjects(true);
+}
+
+void Renderer::destroyRetiredObjects(bool all)
+{
+    // Only frames submitted before retiredFrame can use a retired object
+    auto isUnused = [&](const auto& retired) {
+        return all || framePacer.getCompletedFrames() >= retired.retiredFrame;
+    };
+    for (const auto& retired : retiredPipelines) {
+        if (isUnused(retired)) {
+            vkDestroyPipeline(device, retired.pipeline, nullptr);
+        }
+    }
+    std::erase_if(retiredPipelines, isUnused);
+    for (auto& retired : retiredSwapChains) {
+        if (!isUnused(retired)) {
+            continue;
+        }
+        for (auto view : retired.imageViews) {
+            renderGraph.releaseView(view);
+            vkDestroyImageView(device, view, nullptr);
+        }
+        vkDestroySwapchainKHR(device, retired.swapChain, nullptr);
+    }
+    std::erase_if(retiredSwapChains, isUnused);
 }
 
 void Renderer::recreateSwapChain()
@@ -856,222 +1606,176 @@ void Renderer::recreateSwapChain()
         glfwGetFramebufferSize(window, &width, &height);
         glfwWaitEvents();
     }
-    vkDeviceWaitIdle(device);
 
-    cleanupSwapChain();
+    // Frames in flight may still render to the old images, so the old objects are retired
+    // instead of waiting for the device to go idle
+    retiredSwapChains.push_back(RetiredSwapChain{.retiredFrame = frameNumber,
+        .swapChain = swapChain,
+        .imageViews = std::move(swapChainImageViews)});
+    swapChainImageViews.clear();
 
-    createSwapChain();
+    auto oldFormat = swapChainImageFormat;
+    createSwapChain(retiredSwapChains.back().swapChain);
+    if (swapChainImageFormat != oldFormat) {
+        // Only happens when the surface formats change, e.g. when moving to another display
+        spdlog::info("Swap chain format changed. Recreating render pass and pipeline");
+        // A build in progress uses the old render pass. The new pipeline reads the shader
+        // files anyway
+        discardPendingPipeline();
+        shadersChanged = false;
+        vkDeviceWaitIdle(device);
+        vkDestroyPipeline(device, graphicsPipeline, nullptr);
+        vkDestroyPipeline(device, depthPrepassPipeline, nullptr);
+        createRenderPass();
+        auto pipelines = buildScenePipelines(pipelineCache.get());
+        graphicsPipeline = pipelines.main;
+        depthPrepassPipeline = pipelines.depthPrepass;
+    }
     createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createFrameBuffers();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
-    createCommandBuffers();
 }
 
-uint32_t Renderer::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+void Renderer::updateShaders()
 {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
-        if ((typeFilter & (1 << i)) &&
-            (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
+    if (!config.watchShaders) {
+        return;
+    }
+    if (!shaderWatcher.takeCompiled().empty()) {
+        shadersChanged = true;
+    }
+    if (pendingPipeline.valid() &&
+        pendingPipeline.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            auto pipelines = pendingPipeline.get();
+            // Frames in flight still draw with the old pipelines
+            for (auto pipeline : {graphicsPipeline, depthPrepassPipeline}) {
+                retiredPipelines.push_back(
+                    RetiredPipeline{.retiredFrame = frameNumber, .pipeline = pipeline});
+            }
+            graphicsPipeline = pipelines.main;
+            depthPrepassPipeline = pipelines.depthPrepass;
+            spdlog::info("Reloaded shaders");
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to rebuild the pipeline, keeping the old one: {}", e.what());
         }
     }
-    throw std::runtime_error("Failed to find memory of the required type");
-}
-
-void Renderer::copyBufferToImage(
-    VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
-{
-    VkBufferImageCopy region{.bufferOffset = 0,
-        .bufferRowLength = 0,
-        .bufferImageHeight = 0,
-        .imageSubresource = VkImageSubresourceLayers{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1},
-        .imageOffset = VkOffset3D{.x = 0, .y = 0, .z = 0},
-        .imageExtent = VkExtent3D{.width = width, .height = height, .depth = 1}};
-
-    vkCmdCopyBufferToImage(
-        commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    // One build at a time. Shaders changed during a build are picked up by the next one
+    if (shadersChanged && !pendingPipeline.valid()) {
+        shadersChanged = false;
+        pendingPipeline = std::async(
+            std::launch::async, [this] { return buildScenePipelines(pipelineCache.get()); });
+    }
 }
 
-void Renderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-    VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+void Renderer::discardPendingPipeline()
 {
-    VkBufferCreateInfo bufferInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = size,
-        .usage = usage,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
-    auto res = vkCreateBuffer(device, &bufferInfo, nullptr, &buffer);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create vertex buffer");
+    if (!pendingPipeline.valid()) {
+        return;
     }
-
-    VkMemoryRequirements memRequirements{};
-    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memRequirements.size,
-        .memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties)};
-
-    res = vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate buffer memory");
+    try {
+        auto pipelines = pendingPipeline.get();
+        vkDestroyPipeline(device, pipelines.main, nullptr);
+        vkDestroyPipeline(device, pipelines.depthPrepass, nullptr);
+    } catch (const std::exception&) {
+        // Nothing was created
     }
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
 }
 
-VkCommandBuffer Renderer::beginSingleTimeCommands()
+void Renderer::logPacingStats()
 {
-    VkCommandBufferAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1};
-
-    VkCommandBuffer commandBuffer = nullptr;
-    auto res = vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-    if (res != VK_SUCCESS) {
-        throw std::runtime_error("Failed allocating copy buffer command buffer");
-    }
-    VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    return commandBuffer;
+    auto stats = framePacer.takeStats();
+    spdlog::debug("Frame pacing: {:.2f} ms latency (max {:.2f}), {:.2f} ms waiting, "
+                  "{:.1f} frames queued, latency limit {} of {} in flight",
+        stats.latencyMsAvg, stats.latencyMsMax, stats.waitMsAvg, stats.queuedFramesAvg,
+        framePacer.getLatencyLimit(), framesInFlight);
 }
 
-void Renderer::endSingleTimeCommands(VkCommandBuffer buffer)
+void Renderer::logMemoryStats()
 {
-    vkEndCommandBuffer(buffer);
-
-    VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &buffer};
-
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &buffer);
+    auto stats = allocator.getStats();
+    spdlog::debug("GPU memory: {} KB used, {} KB allocated, {} KB reserved in {} blocks, "
+                  "{} allocations, {:.1f}% fragmentation",
+        stats.bytesUsed / 1024, stats.bytesAllocated / 1024, stats.bytesReserved / 1024,
+        stats.deviceMemoryCount, stats.allocationCount, stats.fragmentation * 100.0f);
+    const auto& transient = renderGraph.getTransientStats();
+    spdlog::debug("Transient images: {} KB peak, {} KB without aliasing, {} KB lazily allocated",
+        transient.peakBytes / 1024, transient.unaliasedBytes / 1024, transient.lazyBytes / 1024);
 }
 
-void Renderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void Renderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory)
 {
-    auto commandBuffer = beginSingleTimeCommands();
-    VkBufferCopy copyRegion{.size = size};
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-    endSingleTimeCommands(commandBuffer);
+    const std::vector<uint32_t> noSharing;
+    allocator.createBuffer(size, usage, properties, buffer, bufferMemory,
+        (usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT) ? uploadQueueFamilies : noSharing);
 }
 
-void Renderer::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat,
-    VkImageLayout oldLayout, VkImageLayout newLayout)
+void Renderer::createMeshes()
 {
-    VkImageMemoryBarrier barrier{.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = 0,
-        .dstAccessMask = 0,
-        .oldLayout = oldLayout,
-        .newLayout = newLayout,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = image,
-        .subresourceRange = VkImageSubresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .baseMipLevel = 0,
-            .levelCount = 1,
-            .baseArrayLayer = 0,
-            .layerCount = 1}};
-
-    VkPipelineStageFlagBits sourceStage;
-    VkPipelineStageFlagBits destStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
-        newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        destStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-               newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        destStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    } else {
-        throw std::runtime_error("Unsupported layout transition");
+    meshes.init(allocator, uploadQueueFamilies, MESH_VERTEX_CAPACITY, MESH_INDEX_CAPACITY);
+    demoMeshes.clear();
+    if (assetPack) {
+        for (const auto& entry : assetPack->getEntries()) {
+            if (entry.type != Assets::AssetType::Mesh) {
+                continue;
+            }
+            auto vertexCount = entry.info[0];
+            auto indexCount = entry.info[1];
+            if (entry.info[2] != sizeof(Vertex) ||
+                entry.size != sizeof(Vertex) * vertexCount + sizeof(uint32_t) * indexCount) {
+                throw std::runtime_error("Asset pack mesh was baked with another vertex layout");
+            }
+            // Pack data is aligned for any element type
+            auto data = assetPack->getData(entry);
+            std::span vertices{reinterpret_cast<const Vertex*>(data.data()), vertexCount};
+            std::span indices{
+                reinterpret_cast<const uint32_t*>(data.data() + vertices.size_bytes()), indexCount};
+            demoMeshes.push_back(meshes.add(uploads, vertices, indices));
+        }
+    }
+    if (demoMeshes.empty()) {
+        demoMeshes = {meshes.add(uploads, makeQuad()), meshes.add(uploads, makeCube())};
     }
-    vkCmdPipelineBarrier(
-        commandBuffer, sourceStage, destStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-}
-
-void Renderer::createVertexBuffer()
-{
-    VkBuffer stagingBuffer = nullptr;
-    VkDeviceMemory stagingBufferMemory = nullptr;
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-        stagingBufferMemory);
-
-    void* data = nullptr;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
 }
 
-void Renderer::createIndexBuffer()
+void Renderer::createSceneBuffers()
 {
-    VkBuffer stagingBuffer = nullptr;
-    VkDeviceMemory stagingBufferMemory = nullptr;
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-        stagingBufferMemory);
-
-    void* data = nullptr;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), static_cast<size_t>(bufferSize));
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    sceneBuffers.resize(framesInFlight);
+    for (auto& buffers : sceneBuffers) {
+        // Read as vertex attributes, or by the culling shader when that is on
+        createBuffer(sizeof(InstanceData) * MAX_SCENE_INSTANCES,
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            buffers.instances, buffers.instancesMemory);
+        createBuffer(sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAW_BATCHES,
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            buffers.drawCommands, buffers.drawCommandsMemory);
+    }
+    if (gpuCulling) {
+        std::vector<VkBuffer> instanceBuffers;
+        for (const auto& buffers : sceneBuffers) {
+            instanceBuffers.push_back(buffers.instances);
+        }
+        culler.init(device, allocator, pipelineCache.get(), instanceBuffers, MAX_SCENE_INSTANCES,
+            MAX_DRAW_BATCHES, cmdDrawIndexedIndirectCount != nullptr);
+    }
 }
 
 void Renderer::createUniformBuffers()
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-    uniformBuffers.resize(swapChainImages.size());
-    uniformBuffersMemory.resize(swapChainImages.size());
-    for (size_t i = 0; i < swapChainImages.size(); ++i) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            uniformBuffers[i], uniformBuffersMemory[i]);
-    }
+    uniformRing.init(allocator, deviceProperties.limits.minUniformBufferOffsetAlignment,
+        framesInFlight, UNIFORM_RING_FRAME_SIZE);
 }
 
 void Renderer::createDescriptorPool()
 {
-    std::array poolSizes{VkDescriptorPoolSize{.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                             .descriptorCount = static_cast<uint32_t>(swapChainImages.size())},
+    std::array poolSizes{VkDescriptorPoolSize{.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                             .descriptorCount = framesInFlight},
         VkDescriptorPoolSize{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .descriptorCount = static_cast<uint32_t>(swapChainImages.size())}};
+            .descriptorCount = framesInFlight}};
 
     VkDescriptorPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = static_cast<uint32_t>(swapChainImages.size()),
+        .maxSets = framesInFlight,
         .poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
         .pPoolSizes = poolSizes.data()};
     auto res = vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool);
@@ -1082,23 +1786,24 @@ void Renderer::createDescriptorPool()
 
 void Renderer::createDescriptorSets()
 {
-    std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), descriptorSetLayout);
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
         .descriptorPool = descriptorPool,
-        .descriptorSetCount = static_cast<uint32_t>(swapChainImages.size()),
+        .descriptorSetCount = framesInFlight,
         .pSetLayouts = layouts.data()};
-    descriptorSets.resize(swapChainImages.size());
+    descriptorSets.resize(framesInFlight);
+    descriptorTextureVersions.resize(framesInFlight);
     auto res = vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data());
     if (res != VK_SUCCESS) {
         throw std::runtime_error("Failed to create descriptor sets");
     }
-    size_t i = 0;
-    for (auto& buf : uniformBuffers) {
+    for (size_t i = 0; i < descriptorSets.size(); ++i) {
+        // Offset is supplied at bind time, the range covers a single object
         VkDescriptorBufferInfo bufferInfo{
-            .buffer = buf, .offset = 0, .range = sizeof(UniformBufferObject)};
+            .buffer = uniformRing.getBuffer(), .offset = 0, .range = sizeof(UniformBufferObject)};
 
         VkDescriptorImageInfo imageInfo{.sampler = textureSampler,
-            .imageView = textureImageView,
+            .imageView = textures.getView(demoTexture),
             .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
 
         std::array descriptorWrites = {
@@ -1107,7 +1812,7 @@ void Renderer::createDescriptorSets()
                 .dstBinding = 0,
                 .dstArrayElement = 0,
                 .descriptorCount = 1,
-                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
                 .pBufferInfo = &bufferInfo},
             VkWriteDescriptorSet{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
                 .dstSet = descriptorSets[i],
@@ -1120,10 +1825,29 @@ void Renderer::createDescriptorSets()
         ;
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()),
             descriptorWrites.data(), 0, nullptr);
-        ++i;
+        descriptorTextureVersions[i] = textures.getVersion();
     }
 }
 
+void Renderer::updateTextureDescriptors(uint32_t frame)
+{
+    if (descriptorTextureVersions[frame] == textures.getVersion()) {
+        return;
+    }
+    VkDescriptorImageInfo imageInfo{.sampler = textureSampler,
+        .imageView = textures.getView(demoTexture),
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkWriteDescriptorSet descriptorWrite{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = descriptorSets[frame],
+        .dstBinding = 1,
+        .dstArrayElement = 0,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        .pImageInfo = &imageInfo};
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    descriptorTextureVersions[frame] = textures.getVersion();
+}
+
 SwapChainSupportDetails Renderer::querySwapChainSupport(VkPhysicalDevice d)
 {
     SwapChainSupportDetails details;
@@ -1160,16 +1884,34 @@ QueueFamilyIndices Renderer::findQueueFamilies(VkPhysicalDevice d)
 
     uint32_t i = 0;
     for (const auto& queueFamily : queueFamilies) {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && !res.graphicsFamily.has_value()) {
+        // Culling runs on the graphics queue, so it has to take compute work as well
+        bool graphicsCompute = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                               (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT);
+        if (graphicsCompute && !res.graphicsFamily.has_value()) {
             res.graphicsFamily = i;
         }
+        bool transferOnly = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                            !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+                            !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT);
+        if (transferOnly && !res.transferFamily.has_value()) {
+            res.transferFamily = i;
+        }
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(d, i, surface, &presentSupport);
+        if (surface) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(d, i, surface, &presentSupport);
+        }
         if (presentSupport && !res.presentFamily.has_value()) {
             res.presentFamily = i;
         }
         i++;
     }
+    if (config.headless) {
+        // Nothing is ever presented; alias the graphics queue so the rest of the setup is shared
+        res.presentFamily = res.graphicsFamily;
+    }
+    if (!res.transferFamily.has_value()) {
+        res.transferFamily = res.graphicsFamily;
+    }
 
     return res;
 }
@@ -1203,15 +1945,74 @@ VkExtent2D Renderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabiliti
 VkPresentModeKHR Renderer::chooseSwapPresentMode(
     const std::vector<VkPresentModeKHR>& availablePresentModes)
 {
-    for (const auto& availablePresentMode : availablePresentModes) {
-        if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return availablePresentMode;
+    std::vector<VkPresentModeKHR> preferredModes;
+    switch (config.presentPolicy) {
+        case PresentPolicy::LowLatency:
+            // Immediate may tear but shows a frame as soon as it is done
+            preferredModes = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+        case PresentPolicy::PowerSaving:
+            // FIFO blocks at the display rate instead of rendering frames nobody sees
+            break;
+        case PresentPolicy::Throughput:
+            preferredModes = {VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+    }
+    for (auto mode : preferredModes) {
+        if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) !=
+            availablePresentModes.end()) {
+            return mode;
         }
     }
-
+    // The only mode every device supports
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+uint32_t Renderer::chooseSwapImageCount(
+    const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR mode)
+{
+    // The minimum is what the presentation engine needs to hand out one image at a time
+    uint32_t imageCount = capabilities.minImageCount;
+    switch (config.presentPolicy) {
+        case PresentPolicy::LowLatency:
+            // Mailbox replaces a queued image with a newer one, which needs a spare to render
+            // into. Immediate shows images right away, so no more are needed
+            if (mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+                ++imageCount;
+            }
+            break;
+        case PresentPolicy::PowerSaving:
+            // One to render into while another waits for the vertical blank
+            ++imageCount;
+            break;
+        case PresentPolicy::Throughput:
+            // The most frames in flight can use. More would only sit in the queue
+            imageCount += framesInFlight;
+            break;
+    }
+    if (capabilities.maxImageCount > 0) {
+        imageCount = std::min(imageCount, capabilities.maxImageCount);
+    }
+    return imageCount;
+}
+
+void Renderer::applyPresentPolicy()
+{
+    auto latencyLimit = config.latencyLimit;
+    if (latencyLimit == 0 && config.presentPolicy == PresentPolicy::LowLatency) {
+        latencyLimit = 1;
+    }
+    auto frameRateCap = config.frameRateCap;
+    if (frameRateCap == 0 && config.presentPolicy == PresentPolicy::PowerSaving) {
+        frameRateCap = POWER_SAVING_FRAME_RATE;
+    }
+    framePacer.setLatencyLimit(latencyLimit);
+    framePacer.setFrameRateCap(frameRateCap);
+    spdlog::info("Present policy {}: latency limit {} of {} frames in flight, frame rate cap {}",
+        getPresentPolicyName(config.presentPolicy), framePacer.getLatencyLimit(), framesInFlight,
+        frameRateCap > 0 ? std::to_string(frameRateCap) + " FPS" : std::string{"none"});
+}
+
 VkSurfaceFormatKHR Renderer::chooseSwapSurfaceFormat(
     const std::vector<VkSurfaceFormatKHR>& availableFormats)
 {
@@ -1255,10 +2056,15 @@ void Renderer::cleanupDebugMessenger()
 
 std::vector<const char*> Renderer::getRequiredExtensions()
 {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions = nullptr;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> extensions;
+    if (!config.headless) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = nullptr;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
+    // Required by VK_KHR_timeline_semaphore on a Vulkan 1.0 instance
+    extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -1308,10 +2114,35 @@ void Renderer::checkValidationLayerSupport()
 
 void Renderer::run()
 {
-    initWindow();
-    initVulkan();
-    mainLoop();
+    if (!config.headless) {
+        initWindow();
+    }
+    if (!config.tracePath.empty()) {
+        Utils::Trace::start(config.tracePath);
+    }
+    VZ_TRACE_THREAD_NAME("Render thread");
+    auto initStart = std::chrono::steady_clock::now();
+    {
+        VZ_TRACE_SCOPE("Init Vulkan");
+        initVulkan();
+    }
+    std::chrono::duration<double, std::milli> initTime =
+        std::chrono::steady_clock::now() - initStart;
+    spdlog::info("Vulkan initialized in {:.1f} ms with a {} pipeline cache", initTime.count(),
+        pipelineCache.getLoadedSize() > 0 ? "warm" : "cold");
+    if (config.benchStartup) {
+        runStartupBenchmark();
+    } else if (config.benchInstances) {
+        runInstanceBenchmark();
+    } else if (config.benchMips) {
+        runMipBenchmark();
+    } else if (config.benchPresent) {
+        runPresentBenchmark();
+    } else {
+        mainLoop();
+    }
     cleanup();
+    Utils::Trace::stop();
 }
 
 void Renderer::initWindow()
@@ -1319,65 +2150,106 @@ void Renderer::initWindow()
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-    window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+    window = glfwCreateWindow(static_cast<int>(config.width), static_cast<int>(config.height),
+        "Vulkan", nullptr, nullptr);
     glfwSetWindowUserPointer(window, this);
     glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
 }
 
 void Renderer::initVulkan()
 {
+    if (!config.assetPackPath.empty()) {
+        assetPack.emplace(config.assetPackPath);
+    }
     createInstance();
     setupDebugMessenger();
-    createSurface();
+    if (!config.headless) {
+        createSurface();
+    }
     pickPhysicalDevice();
     createLogicalDevice();
-    createSwapChain();
+    allocator.init(physicalDevice, device);
+    pipelineCache.init(device, deviceProperties, config.pipelineCachePath);
+    renderGraph.init(device, allocator, framesInFlight);
+    profiler.init(physicalDevice, device,
+        findQueueFamilies(physicalDevice).graphicsFamily.value(), framesInFlight);
+    if (config.headless) {
+        createOffscreenTargets();
+    } else {
+        createSwapChain();
+    }
     createImageViews();
+    depthFormat = findDepthFormat();
     createRenderPass();
     createDescriptorSetLayout();
     createGraphicsPipeline();
-    createFrameBuffers();
-    createCommandPool();
-    createTextureImage();
-    createTextureImageView();
+    createFrameCommands();
+    createUploadManager();
+    createTextures();
     createTextureSampler();
-    createVertexBuffer();
-    createIndexBuffer();
+    createMeshes();
+    sceneUploads = uploads.flush();
+    createSceneBuffers();
     createUniformBuffers();
     createDescriptorPool();
     createDescriptorSets();
-    createCommandBuffers();
     createSyncObjects();
+    if (config.watchShaders) {
+        // Compiled next to the startup shaders, the paths buildScenePipelines reads.
+        // cull.comp is created once by the culler and needs a restart
+        shaderWatcher.start(config.shaderSourceDir, "shaders", {"shader.vert", "shader.frag"});
+    }
 }
 
 void Renderer::cleanup()
 {
+    // Whatever loop ran last may have returned with frames still in flight
+    vkDeviceWaitIdle(device);
+    shaderWatcher.stop();
+    discardPendingPipeline();
     cleanupSwapChain();
+    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    vkDestroyPipeline(device, depthPrepassPipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    uniformRing.destroy(allocator);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
     vkDestroySampler(device, textureSampler, nullptr);
-    vkDestroyImageView(device, textureImageView, nullptr);
-    vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    textures.destroy();
+    if (gpuCulling) {
+        culler.destroy(allocator);
+    }
+    for (auto& buffers : sceneBuffers) {
+        allocator.destroyBuffer(buffers.drawCommands, buffers.drawCommandsMemory);
+        allocator.destroyBuffer(buffers.instances, buffers.instancesMemory);
+    }
+    meshes.destroy(allocator);
     std::for_each(renderFinishedSemaphores.begin(), renderFinishedSemaphores.end(),
         [this](auto& s) { vkDestroySemaphore(device, s, nullptr); });
     std::for_each(imageAvailableSemaphores.begin(), imageAvailableSemaphores.end(),
         [this](auto& s) { vkDestroySemaphore(device, s, nullptr); });
-    std::for_each(inFlightFences.begin(), inFlightFences.end(),
-        [this](auto& s) { vkDestroyFence(device, s, nullptr); });
-    vkDestroyCommandPool(device, commandPool, nullptr);
-
+    framePacer.destroy();
+    destroyFrameCommands();
+
+    uploads.destroy();
+    renderGraph.destroy();
+    allocator.destroy();
+    pipelineCache.save();
+    pipelineCache.destroy();
+    profiler.destroy();
     vkDestroyDevice(device, nullptr);
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (surface) {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
 
     cleanupDebugMessenger();
     vkDestroyInstance(instance, nullptr);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 }
 
 #ifdef WIN32
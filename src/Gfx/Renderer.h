@@ -1,25 +1,56 @@
 #pragma once
 
+#include "Assets/AssetPack.h"
+#include "Config.h"
+#include "FramePacer.h"
+#include "FrustumCuller.h"
+#include "MemoryAllocator.h"
+#include "MeshRegistry.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "RenderGraph.h"
+#include "Scene.h"
+#include "ShaderWatcher.h"
+#include "TextureManager.h"
+#include "UniformRing.h"
+#include "UploadManager.h"
 #include "Vertex.h"
+#include "Utils/ThreadPool.h"
 
 #include "vk_wrap.h"
 
+#include <array>
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
 #include <cassert>
 #include <vector>
 #include <optional>
+#include <future>
+#include <memory>
 #include <set>
+#include <span>
 
 namespace VaryZulu::Gfx
 {
-constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Upper bound of Config::framesInFlight
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+// Per-frame slice of the uniform ring
+constexpr VkDeviceSize UNIFORM_RING_FRAME_SIZE = 256 * 1024;
+constexpr VkDeviceSize STAGING_RING_SIZE = 16 * 1024 * 1024;
+constexpr uint32_t MAX_SCENE_INSTANCES = 128 * 1024;
+constexpr uint32_t MAX_DRAW_BATCHES = 1024;
+constexpr uint32_t MESH_VERTEX_CAPACITY = 256 * 1024;
+constexpr uint32_t MESH_INDEX_CAPACITY = 1024 * 1024;
+// Below this many draws per thread recording is not worth splitting across workers
+constexpr size_t MIN_DRAWS_PER_THREAD = 64;
 
 struct QueueFamilyIndices
 {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // Prefers a transfer-only family, falls back to the graphics family
+    std::optional<uint32_t> transferFamily;
 
     bool isComplete() const
     {
@@ -33,6 +64,54 @@ struct QueueFamilyIndices
     }
 };
 
+// Command recording state of one frame in flight. The pools are reset as a whole once the
+// frame pacer reports the slot's previous frame finished, so nothing is freed individually
+struct FrameCommands
+{
+    VkCommandPool primaryPool = nullptr;
+    VkCommandBuffer primary = nullptr;
+    // One pool and one secondary command buffer per recording thread. Pools are externally
+    // synchronized, so threads never share one
+    std::vector<VkCommandPool> threadPools;
+    std::vector<VkCommandBuffer> secondaries;
+    // Depth pre-pass draws, executed before all of secondaries. Allocated from threadPools
+    std::vector<VkCommandBuffer> prepassSecondaries;
+};
+
+// Swapchain objects replaced by a resize. Frames submitted before retiredFrame may still use
+// them, so they are destroyed only once the frame pacer has seen all of those finish
+struct RetiredSwapChain
+{
+    uint64_t retiredFrame = 0;
+    VkSwapchainKHR swapChain = nullptr;
+    std::vector<VkImageView> imageViews;
+};
+
+// Pipelines that draw the scene. They share the vertex shader, so a reload rebuilds both
+struct ScenePipelines
+{
+    VkPipeline main = nullptr;
+    // Only with Config::depthPrepass
+    VkPipeline depthPrepass = nullptr;
+};
+
+// Pipeline replaced by a shader reload, destroyed like a RetiredSwapChain
+struct RetiredPipeline
+{
+    uint64_t retiredFrame = 0;
+    VkPipeline pipeline = nullptr;
+};
+
+// Scene data of one frame in flight, written by the CPU while the GPU reads the other frames
+struct FrameSceneBuffers
+{
+    VkBuffer instances = nullptr;
+    Allocation instancesMemory;
+    // One VkDrawIndexedIndirectCommand per batch
+    VkBuffer drawCommands = nullptr;
+    Allocation drawCommandsMemory;
+};
+
 struct SwapChainSupportDetails
 {
     VkSurfaceCapabilitiesKHR capabilities{};
@@ -43,6 +122,8 @@ struct SwapChainSupportDetails
 class Renderer
 {
 public:
+    explicit Renderer(const Config& initialConfig);
+
     void run();
 
 private:
@@ -53,49 +134,74 @@ private:
     void initVulkan();
     void cleanupSwapChain();
     void recreateSwapChain();
+    // Destroys retired swapchains and pipelines that no frame in flight can reference anymore,
+    // or all of them
+    void destroyRetiredObjects(bool all);
     void createSyncObjects();
-    void createCommandBuffers();
-    void createCommandPool();
-    void createTextureImage();
-    void createTextureImageView();
+    void createFrameCommands();
+    void destroyFrameCommands();
+    void recordCommandBuffer(FrameCommands& frame, uint32_t imageIdx);
+    // Records the draws into secondaries, split across threads, and executes them
+    void recordMainPass(FrameCommands& frame, const PassContext& context);
+    void recordDraws(VkCommandBuffer commandBuffer, VkPipeline pipeline, size_t firstBatch,
+        size_t lastBatch);
+    void createUploadManager();
+    void createTextures();
     void createTextureSampler();
-    void createFrameBuffers();
+    VkSampler createSampler(float maxLod);
+    // Points the frame's descriptor set at the current texture views if they changed
+    void updateTextureDescriptors(uint32_t frame);
+    // Prefers formats without stencil, nothing uses it
+    VkFormat findDepthFormat();
+    // Compatible with the passes the render graph begins, for pipelines and inheritance
     void createRenderPass();
-    VkShaderModule createShaderModule(const std::vector<char>& code);
+    VkShaderModule createShaderModule(std::span<const std::byte> code);
+    // Uses the SPIR-V in the asset pack if it has path, reads the file otherwise
+    VkShaderModule loadShaderModule(const std::string& path);
     void createDescriptorSetLayout();
     void createGraphicsPipeline();
+    // depthOnly builds the pre-pass pipeline, which only runs the vertex shader
+    VkPipeline buildGraphicsPipeline(VkPipelineCache cache, bool depthOnly = false);
+    ScenePipelines buildScenePipelines(VkPipelineCache cache);
+    // Starts a pipeline build when recompiled shaders arrived and swaps in a finished one.
+    // Called at the start of a frame
+    void updateShaders();
+    // Waits for a pipeline build in progress and destroys its result
+    void discardPendingPipeline();
     void createImageViews();
-    void createSwapChain();
+    void createSwapChain(VkSwapchainKHR oldSwapChain = nullptr);
+    void createOffscreenTargets();
     void createSurface();
     void createLogicalDevice();
-    void createVertexBuffer();
-    void createIndexBuffer();
+    void createMeshes();
+    void createSceneBuffers();
     void createUniformBuffers();
     void createDescriptorPool();
     void createDescriptorSets();
-    VkImageView createImageView(VkImage image, VkFormat format);
-    void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image,
-        uint32_t width, uint32_t height);
+    VkImageView createImageView(VkImage image, VkFormat format,
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-        VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+        VkBuffer& buffer, Allocation& bufferMemory);
     void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
         VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image,
-        VkDeviceMemory& imageMemory);
-    VkCommandBuffer beginSingleTimeCommands();
-    void endSingleTimeCommands(VkCommandBuffer buffer);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat,
-        VkImageLayout oldLayout, VkImageLayout newLayout);
+        Allocation& imageMemory);
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice d);
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice d);
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
+    // Picks the mode and image count config.presentPolicy asks for
     VkPresentModeKHR chooseSwapPresentMode(
         const std::vector<VkPresentModeKHR>& availablePresentModes);
+    uint32_t chooseSwapImageCount(
+        const VkSurfaceCapabilitiesKHR& capabilities, VkPresentModeKHR mode);
+    // Sets the latency limit and frame rate cap of config.presentPolicy
+    void applyPresentPolicy();
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(
         const std::vector<VkSurfaceFormatKHR>& availableFormats);
     bool isDeviceSuitable(VkPhysicalDevice d);
+    uint64_t scoreDevice(VkPhysicalDevice d);
     bool checkDeviceExtensionSupport(VkPhysicalDevice d);
     void pickPhysicalDevice();
+    void reportDeviceCapabilities();
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo);
     void setupDebugMessenger();
     void cleanupDebugMessenger();
@@ -103,17 +209,26 @@ private:
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT,
         const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void*);
-    void updateUniformBuffer(uint32_t currImage);
+    void updateScene(uint32_t frame);
     void createInstance();
     void mainLoop();
+    // Times graphics pipeline creation with an empty and with the loaded pipeline cache
+    void runStartupBenchmark();
+    // Renders a fixed number of frames at growing instance counts and reports frame times
+    void runInstanceBenchmark();
+    // Renders a minified grid with mipmapping off and on and reports GPU frame times
+    void runMipBenchmark();
+    // Renders a fixed number of frames with each present policy and reports frame times and
+    // latency
+    void runPresentBenchmark();
     bool drawFrame();
     void cleanup();
     void checkValidationLayerSupport();
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    void logMemoryStats();
+    void logPacingStats();
 
+    Config config;
     GLFWwindow* window = nullptr;
-    static constexpr uint32_t WIDTH = 800;
-    static constexpr uint32_t HEIGHT = 600;
 
     const std::vector<const char*> validationLayers = {"VK_LAYER_KHRONOS_validation"};
     static constexpr bool enableValidationLayers =
@@ -123,51 +238,81 @@ private:
         false
 #endif
         ;
-    const std::vector<const char*> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    std::vector<const char*> deviceExtensions;
     VkInstance instance = nullptr;
     VkDebugUtilsMessengerEXT debugMessenger = nullptr;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties deviceProperties{};
+    VkPhysicalDeviceFeatures supportedFeatures{};
+    VkPhysicalDeviceFeatures enabledFeatures{};
     VkDevice device = nullptr;
+    MemoryAllocator allocator;
+    PipelineCache pipelineCache;
+    Profiler profiler;
+    std::optional<Assets::AssetPack> assetPack;
     VkQueue graphicsQueue = nullptr;
     VkQueue presentQueue = nullptr;
+    VkQueue transferQueue = nullptr;
+    // Queue families that touch uploaded resources. More than one means concurrent sharing
+    std::vector<uint32_t> uploadQueueFamilies;
+    UploadManager uploads;
+    UploadTicket sceneUploads = 0;
     VkSurfaceKHR surface = nullptr;
     VkSwapchainKHR swapChain = nullptr;
     std::vector<VkImage> swapChainImages;
+    // Headless mode only: memory backing swapChainImages
+    std::vector<Allocation> offscreenImagesMemory;
+    uint32_t nextOffscreenImage = 0;
     std::vector<VkImageView> swapChainImageViews;
-    std::vector<VkFramebuffer> swapChainFramebuffers;
-    std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<RetiredSwapChain> retiredSwapChains;
     VkFormat swapChainImageFormat = VK_FORMAT_UNDEFINED;
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
     VkExtent2D swapChainExtent{};
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    // Owned by renderGraph
     VkRenderPass renderPass = nullptr;
+    // Owns the depth buffer, render passes and framebuffers
+    RenderGraph renderGraph;
     VkDescriptorSetLayout descriptorSetLayout = nullptr;
     VkPipelineLayout pipelineLayout = nullptr;
     VkPipeline graphicsPipeline = nullptr;
-    VkCommandPool commandPool = nullptr;
+    VkPipeline depthPrepassPipeline = nullptr;
+    std::vector<RetiredPipeline> retiredPipelines;
+    ShaderWatcher shaderWatcher;
+    // Built on another thread from reloaded shaders
+    std::future<ScenePipelines> pendingPipeline;
+    // Shaders recompiled after the pending build, if any, started
+    bool shadersChanged = false;
+    // One per frame in flight, indexed by slot
+    std::vector<FrameCommands> frameCommands;
+    std::unique_ptr<Utils::ThreadPool> recordThreads;
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    std::vector<VkFence> inFlightImages;
+    FramePacer framePacer;
+    uint32_t framesInFlight = 2;
+    // Slot of the frame being recorded
     size_t currentFrame = 0;
+    // Number of frames submitted so far
+    uint64_t frameNumber = 0;
     bool framebufferResized = false;
-    VkBuffer vertexBuffer = nullptr;
-    VkDeviceMemory vertexBufferMemory = nullptr;
-    VkBuffer indexBuffer = nullptr;
-    VkDeviceMemory indexBufferMemory = nullptr;
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    MeshRegistry meshes;
+    std::vector<MeshHandle> demoMeshes;
+    Scene scene;
+    std::vector<FrameSceneBuffers> sceneBuffers;
+    FrustumCuller culler;
+    bool gpuCulling = false;
+    // VK_KHR_draw_indirect_count: culled draws are compacted and their count read on the GPU
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;
+    glm::mat4 frameViewProj{1.0f};
+    UniformRing uniformRing;
+    uint32_t frameUniformOffset = 0;
     VkDescriptorPool descriptorPool = nullptr;
     std::vector<VkDescriptorSet> descriptorSets;
-    VkImage textureImage = nullptr;
-    VkDeviceMemory textureImageMemory = nullptr;
-    VkImageView textureImageView = nullptr;
+    TextureManager textures;
+    TextureHandle demoTexture = 0;
+    // Texture manager version each frame's descriptor set was last written with
+    std::vector<uint64_t> descriptorTextureVersions;
     VkSampler textureSampler = nullptr;
-
-    const std::vector<Vertex> vertices = {
-        Vertex{.pos{-0.5f, -0.5f}, .color{1.0f, 0.0f, 0.0f}, .texCoord{1.0f, 0.0f}},
-        Vertex{.pos{0.5f, -0.5f}, .color{0.0f, 1.0f, 0.0f}, .texCoord{0.0f, 0.0f}},
-        Vertex{.pos{0.5f, 0.5f}, .color{0.0f, 0.0f, 1.0f}, .texCoord{0.0f, 1.0f}},
-        Vertex{.pos{-0.5f, 0.5f}, .color{1.0f, 1.0f, 1.0f}, .texCoord{1.0f, 1.0f}}};
-    const std::vector<uint16_t> indices = {0, 1, 2, 2, 3, 0};
 };
 
 } // namespace VaryZulu::Gfx
@@ -0,0 +1,57 @@
+#include "Scene.h"
+#include "Utils/Trace.h"
+
+namespace VaryZulu::Gfx
+{
+void Scene::clear()
+{
+    submitted.clear();
+    batches.clear();
+}
+
+void Scene::submit(MeshHandle mesh, const glm::mat4& model, const glm::vec4& color)
+{
+    submitted.push_back(
+        Submission{.mesh = mesh, .data = InstanceData{.model = model, .color = color}});
+}
+
+void Scene::submit(MeshHandle mesh, std::span<const InstanceData> instances)
+{
+    submitted.reserve(submitted.size() + instances.size());
+    for (const auto& instance : instances) {
+        submitted.push_back(Submission{.mesh = mesh, .data = instance});
+    }
+}
+
+void Scene::buildBatches(size_t meshCount, InstanceData* dst, uint32_t* dstBatches)
+{
+    VZ_TRACE_SCOPE("Build batches");
+    // Counting sort by mesh: count, turn counts into batch offsets, then scatter
+    cursors.assign(meshCount, 0);
+    meshBatches.assign(meshCount, 0);
+    for (const auto& submission : submitted) {
+        ++cursors[submission.mesh];
+    }
+    batches.clear();
+    uint32_t firstInstance = 0;
+    for (size_t mesh = 0; mesh < meshCount; ++mesh) {
+        auto count = cursors[mesh];
+        cursors[mesh] = firstInstance;
+        if (count > 0) {
+            meshBatches[mesh] = static_cast<uint32_t>(batches.size());
+            batches.push_back(DrawBatch{.mesh = static_cast<MeshHandle>(mesh),
+                .firstInstance = firstInstance,
+                .instanceCount = count});
+        }
+        firstInstance += count;
+    }
+    for (const auto& submission : submitted) {
+        auto idx = cursors[submission.mesh]++;
+        dst[idx] = submission.data;
+        if (dstBatches) {
+            dstBatches[idx] = meshBatches[submission.mesh];
+        }
+    }
+}
+
+} // namespace VaryZulu::Gfx
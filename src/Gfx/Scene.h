@@ -0,0 +1,59 @@
+#pragma once
+
+#include "MeshRegistry.h"
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// All instances of one mesh. Their data is contiguous starting at firstInstance
+struct DrawBatch
+{
+    MeshHandle mesh = 0;
+    uint32_t firstInstance = 0;
+    uint32_t instanceCount = 0;
+};
+
+// Collects the instances submitted for a frame and merges them into one batch per mesh
+class Scene
+{
+public:
+    void clear();
+    void submit(MeshHandle mesh, const glm::mat4& model, const glm::vec4& color = glm::vec4(1.0f));
+    // Adds many instances of one mesh at once
+    void submit(MeshHandle mesh, std::span<const InstanceData> instances);
+
+    // Groups the submitted instances by mesh and writes them to dst in batch order.
+    // dst needs room for getInstanceCount() entries. If dstBatches is set, it receives the
+    // batch index of every written instance
+    void buildBatches(size_t meshCount, InstanceData* dst, uint32_t* dstBatches = nullptr);
+
+    size_t getInstanceCount() const
+    {
+        return submitted.size();
+    }
+
+    const std::vector<DrawBatch>& getBatches() const
+    {
+        return batches;
+    }
+
+private:
+    struct Submission
+    {
+        MeshHandle mesh = 0;
+        InstanceData data;
+    };
+
+    std::vector<Submission> submitted;
+    std::vector<DrawBatch> batches;
+    // Per mesh write cursor of the counting sort
+    std::vector<uint32_t> cursors;
+    std::vector<uint32_t> meshBatches;
+};
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,178 @@
+#include "ShaderWatcher.h"
+#include "Utils/Trace.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <set>
+#include <utility>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifndef VZ_GLSLC_EXECUTABLE
+#define VZ_GLSLC_EXECUTABLE "glslc"
+#endif
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+// Editors save in bursts of events, compiling waits until the directory has been quiet this
+// long
+constexpr int SETTLE_MS = 50;
+// How often the thread checks whether it should stop
+constexpr int STOP_POLL_MS = 200;
+} // namespace
+
+ShaderWatcher::~ShaderWatcher()
+{
+    stop();
+}
+
+void ShaderWatcher::start(const std::string& sourceDirectory, const std::string& outputDirectory,
+    const std::vector<std::string>& sourceNames)
+{
+#ifdef __linux__
+    sourceDir = sourceDirectory;
+    outputDir = outputDirectory;
+    sources = sourceNames;
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        spdlog::error("Failed to initialize inotify, shaders won't be reloaded");
+        return;
+    }
+    // The directory is watched instead of the files, editors often replace a file on save
+    if (inotify_add_watch(inotifyFd, sourceDir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        spdlog::error("Failed to watch {}, shaders won't be reloaded", sourceDir);
+        close(inotifyFd);
+        inotifyFd = -1;
+        return;
+    }
+    stopping = false;
+    thread = std::thread([this] { watchLoop(); });
+    spdlog::info("Watching {} for shader changes", sourceDir);
+#else
+    (void)sourceDirectory;
+    (void)outputDirectory;
+    (void)sourceNames;
+    spdlog::warn("Shader hot reload needs inotify, which this platform lacks");
+#endif
+}
+
+void ShaderWatcher::stop()
+{
+    if (thread.joinable()) {
+        stopping = true;
+        thread.join();
+    }
+#ifdef __linux__
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+#endif
+}
+
+std::vector<std::string> ShaderWatcher::takeCompiled()
+{
+    std::lock_guard lock(mutex);
+    return std::exchange(compiled, {});
+}
+
+void ShaderWatcher::watchLoop()
+{
+#ifdef __linux__
+    VZ_TRACE_THREAD_NAME("Shader watcher");
+    std::set<std::string> changed;
+    // Event records are variable length, the buffer has to be aligned for their header
+    alignas(inotify_event) std::array<char, 4096> buffer{};
+    while (!stopping) {
+        pollfd pollInfo{.fd = inotifyFd, .events = POLLIN, .revents = 0};
+        auto ready = poll(&pollInfo, 1, changed.empty() ? STOP_POLL_MS : SETTLE_MS);
+        if (ready > 0) {
+            ssize_t length = 0;
+            while ((length = read(inotifyFd, buffer.data(), buffer.size())) > 0) {
+                for (ssize_t offset = 0; offset < length;) {
+                    const auto* event = reinterpret_cast<const inotify_event*>(
+                        buffer.data() + offset);
+                    if (event->len > 0) {
+                        changed.insert(event->name);
+                    }
+                    offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                }
+            }
+            continue;
+        }
+        if (changed.empty()) {
+            continue;
+        }
+
+        // Anything that isn't a source is taken to be included by all of them
+        std::vector<std::string> toCompile;
+        bool otherChanged = false;
+        for (const auto& name : changed) {
+            if (std::find(sources.begin(), sources.end(), name) != sources.end()) {
+                toCompile.push_back(name);
+            } else if (!name.ends_with(".spv") && !name.ends_with(".tmp")) {
+                otherChanged = true;
+            }
+        }
+        changed.clear();
+        if (otherChanged) {
+            toCompile = sources;
+        }
+        for (const auto& source : toCompile) {
+            if (compile(source)) {
+                std::lock_guard lock(mutex);
+                compiled.push_back(source);
+            }
+        }
+    }
+#endif
+}
+
+bool ShaderWatcher::compile(const std::string& source) const
+{
+#ifdef __linux__
+    VZ_TRACE_SCOPE("Compile shader");
+    // Written next to the target and renamed, so a reader never sees a partial module
+    auto output = outputDir + "/" + source + ".spv";
+    auto tmpOutput = output + ".tmp";
+    auto command = "\"" + std::string{VZ_GLSLC_EXECUTABLE} + "\" -o \"" + tmpOutput + "\" \"" +
+                   sourceDir + "/" + source + "\" 2>&1";
+    auto* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        spdlog::error("Failed to run {}", VZ_GLSLC_EXECUTABLE);
+        return false;
+    }
+    std::string messages;
+    std::array<char, 256> chunk{};
+    while (auto count = fread(chunk.data(), 1, chunk.size(), pipe)) {
+        messages.append(chunk.data(), count);
+    }
+    if (pclose(pipe) != 0) {
+        spdlog::error("Failed to compile {}:\n{}", source, messages);
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpOutput, output, ec);
+    if (ec) {
+        spdlog::error("Failed to replace {}: {}", output, ec.message());
+        return false;
+    }
+    spdlog::info("Compiled {}", source);
+    return true;
+#else
+    (void)source;
+    return false;
+#endif
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Recompiles GLSL sources with glslc when they change on disk. A background thread waits on
+// inotify events for the source directory and compiles, the render thread polls for the
+// sources that compiled. A change to any other file in the directory, like an include,
+// recompiles every source. Needs inotify, elsewhere start() only logs a warning.
+class ShaderWatcher
+{
+public:
+    ~ShaderWatcher();
+
+    // sources are file names in sourceDir, each compiled to outputDir/<source>.spv
+    void start(const std::string& sourceDir, const std::string& outputDir,
+        const std::vector<std::string>& sources);
+    void stop();
+
+    // Sources compiled successfully since the last call
+    std::vector<std::string> takeCompiled();
+
+private:
+    void watchLoop();
+    bool compile(const std::string& source) const;
+
+    std::string sourceDir;
+    std::string outputDir;
+    std::vector<std::string> sources;
+    int inotifyFd = -1;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+    std::mutex mutex;
+    std::vector<std::string> compiled;
+};
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,74 @@
+#include "StagingRing.h"
+
+#include <spdlog/spdlog.h>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+void StagingRing::init(MemoryAllocator& allocator, VkDeviceSize ringCapacity)
+{
+    capacity = ringCapacity;
+    allocator.createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer,
+        memory);
+    head = 0;
+    spdlog::debug("Staging ring: {} KB", capacity / 1024);
+}
+
+void StagingRing::destroy(MemoryAllocator& allocator)
+{
+    allocator.destroyBuffer(buffer, memory);
+    ranges.clear();
+}
+
+std::optional<VkDeviceSize> StagingRing::allocate(
+    VkDeviceSize size, VkDeviceSize alignment, uint64_t ticket)
+{
+    if (ranges.empty()) {
+        head = 0;
+    }
+    std::optional<VkDeviceSize> offset;
+    auto tail = ranges.empty() ? capacity : ranges.front().begin;
+    if (ranges.empty() || head > tail) {
+        // Free space is [head, capacity) followed by [0, tail)
+        auto aligned = alignUp(head, alignment);
+        if (aligned + size <= capacity) {
+            offset = aligned;
+        } else if (size <= tail && !ranges.empty()) {
+            offset = 0;
+        }
+    } else if (head < tail) {
+        auto aligned = alignUp(head, alignment);
+        if (aligned + size <= tail) {
+            offset = aligned;
+        }
+    }
+    // head == tail with live ranges means the ring is full
+    if (!offset.has_value()) {
+        return std::nullopt;
+    }
+
+    head = offset.value() + size;
+    if (!ranges.empty() && ranges.back().ticket == ticket && ranges.back().end <= offset.value()) {
+        ranges.back().end = head;
+    } else {
+        ranges.push_back(Range{.ticket = ticket, .begin = offset.value(), .end = head});
+    }
+    return offset;
+}
+
+void StagingRing::release(uint64_t completedTicket)
+{
+    while (!ranges.empty() && ranges.front().ticket <= completedTicket) {
+        ranges.pop_front();
+    }
+}
+
+} // namespace VaryZulu::Gfx
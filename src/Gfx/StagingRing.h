@@ -0,0 +1,62 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+namespace VaryZulu::Gfx
+{
+// Persistently mapped host buffer handed out front to back. Every range is tagged with the
+// upload batch that reads it and is reclaimed once that batch has completed.
+class StagingRing
+{
+public:
+    void init(MemoryAllocator& allocator, VkDeviceSize capacity);
+    void destroy(MemoryAllocator& allocator);
+
+    // Returns the offset of a free range or nothing if the ring is too full right now
+    std::optional<VkDeviceSize> allocate(
+        VkDeviceSize size, VkDeviceSize alignment, uint64_t ticket);
+    // Reclaims all ranges of batches up to and including the completed one
+    void release(uint64_t completedTicket);
+
+    bool isEmpty() const
+    {
+        return ranges.empty();
+    }
+
+    VkBuffer getBuffer() const
+    {
+        return buffer;
+    }
+
+    VkDeviceSize getCapacity() const
+    {
+        return capacity;
+    }
+
+    void* getMapped(VkDeviceSize offset) const
+    {
+        return static_cast<char*>(memory.mapped) + offset;
+    }
+
+private:
+    struct Range
+    {
+        uint64_t ticket = 0;
+        VkDeviceSize begin = 0;
+        VkDeviceSize end = 0;
+    };
+
+    VkBuffer buffer = nullptr;
+    Allocation memory;
+    VkDeviceSize capacity = 0;
+    VkDeviceSize head = 0;
+    std::deque<Range> ranges;
+};
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,218 @@
+#include "TextureContainer.h"
+#include "TextureFormats.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+constexpr std::array<unsigned char, 12> KTX2_IDENTIFIER{
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+constexpr size_t KTX2_HEADER_SIZE = 80;
+constexpr size_t KTX2_LEVEL_INDEX_ENTRY_SIZE = 24;
+
+constexpr size_t DDS_HEADER_END = 128;
+constexpr size_t DDS_DX10_HEADER_SIZE = 20;
+constexpr uint32_t DDS_FLAG_MIPMAPCOUNT = 0x20000;
+constexpr uint32_t DDS_PIXEL_FORMAT_FOURCC = 0x4;
+constexpr uint32_t DDS_CAPS2_CUBEMAP = 0x200;
+constexpr uint32_t DDS_CAPS2_VOLUME = 0x200000;
+constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+constexpr uint32_t DDS_MISC_TEXTURECUBE = 0x4;
+
+constexpr uint32_t makeFourCC(char a, char b, char c, char d)
+{
+    return static_cast<uint32_t>(static_cast<unsigned char>(a)) |
+           static_cast<uint32_t>(static_cast<unsigned char>(b)) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(c)) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(d)) << 24;
+}
+
+// Both containers are little endian, like every platform this runs on
+template <typename T>
+T read(std::span<const std::byte> file, size_t offset)
+{
+    if (offset > file.size() || file.size() - offset < sizeof(T)) {
+        throw std::runtime_error("Texture file is truncated");
+    }
+    T value;
+    memcpy(&value, file.data() + offset, sizeof(T));
+    return value;
+}
+
+bool isSupportedFormat(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void checkExtent(const CompressedTexture& texture)
+{
+    if (texture.width == 0 || texture.height == 0) {
+        throw std::runtime_error("Texture has no texels");
+    }
+    if (texture.mipLevels == 0 ||
+        texture.mipLevels > getMipLevelCount(texture.width, texture.height)) {
+        throw std::runtime_error("Texture has an invalid mip level count");
+    }
+}
+
+VkDeviceSize getLevelSize(const CompressedTexture& texture, uint32_t mip)
+{
+    return getImageLevelSize(texture.format, std::max(1u, texture.width >> mip),
+        std::max(1u, texture.height >> mip));
+}
+
+VkDeviceSize getChainSize(const CompressedTexture& texture)
+{
+    VkDeviceSize total = 0;
+    for (uint32_t mip = 0; mip < texture.mipLevels; ++mip) {
+        total += getLevelSize(texture, mip);
+    }
+    return total;
+}
+
+CompressedTexture parseKtx2(std::span<const std::byte> file)
+{
+    CompressedTexture texture{.format = static_cast<VkFormat>(read<uint32_t>(file, 12)),
+        .width = read<uint32_t>(file, 20),
+        .height = read<uint32_t>(file, 24),
+        // 0 asks the loader to generate mips, which block compressed data can't be blitted for
+        .mipLevels = std::max(1u, read<uint32_t>(file, 40))};
+    auto depth = read<uint32_t>(file, 28);
+    auto layers = read<uint32_t>(file, 32);
+    auto faces = read<uint32_t>(file, 36);
+    auto supercompression = read<uint32_t>(file, 44);
+    if (depth > 1 || layers > 1 || faces != 1) {
+        throw std::runtime_error("Only single 2D textures are supported");
+    }
+    if (supercompression != 0) {
+        throw std::runtime_error("Supercompressed KTX2 files are not supported");
+    }
+    if (!isSupportedFormat(texture.format)) {
+        throw std::runtime_error("KTX2 file is not BC1, BC3 or BC7");
+    }
+    checkExtent(texture);
+
+    texture.levels.resize(getChainSize(texture));
+    // Levels are stored smallest first, the index lists them largest first
+    size_t dstOffset = 0;
+    for (uint32_t mip = 0; mip < texture.mipLevels; ++mip) {
+        auto entry = KTX2_HEADER_SIZE + mip * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        auto byteOffset = read<uint64_t>(file, entry);
+        auto byteLength = read<uint64_t>(file, entry + 8);
+        if (byteLength != getLevelSize(texture, mip)) {
+            throw std::runtime_error("KTX2 level size doesn't match its extent");
+        }
+        if (byteOffset > file.size() || file.size() - byteOffset < byteLength) {
+            throw std::runtime_error("Texture file is truncated");
+        }
+        memcpy(texture.levels.data() + dstOffset, file.data() + byteOffset, byteLength);
+        dstOffset += byteLength;
+    }
+    return texture;
+}
+
+VkFormat getDxgiFormat(uint32_t dxgiFormat)
+{
+    switch (dxgiFormat) {
+        case 71:
+            return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72:
+            return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 77:
+            return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78:
+            return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 98:
+            return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99:
+            return VK_FORMAT_BC7_SRGB_BLOCK;
+        default:
+            return VK_FORMAT_UNDEFINED;
+    }
+}
+
+CompressedTexture parseDds(std::span<const std::byte> file)
+{
+    auto flags = read<uint32_t>(file, 8);
+    CompressedTexture texture{.width = read<uint32_t>(file, 16),
+        .height = read<uint32_t>(file, 12),
+        .mipLevels = flags & DDS_FLAG_MIPMAPCOUNT ? std::max(1u, read<uint32_t>(file, 28)) : 1};
+    auto pixelFormatFlags = read<uint32_t>(file, 80);
+    auto fourCC = read<uint32_t>(file, 84);
+    auto caps2 = read<uint32_t>(file, 112);
+    if (caps2 & (DDS_CAPS2_CUBEMAP | DDS_CAPS2_VOLUME)) {
+        throw std::runtime_error("Only single 2D textures are supported");
+    }
+    if (!(pixelFormatFlags & DDS_PIXEL_FORMAT_FOURCC)) {
+        throw std::runtime_error("DDS file is not block compressed");
+    }
+
+    auto dataOffset = DDS_HEADER_END;
+    if (fourCC == makeFourCC('D', 'X', '1', '0')) {
+        texture.format = getDxgiFormat(read<uint32_t>(file, DDS_HEADER_END));
+        auto dimension = read<uint32_t>(file, DDS_HEADER_END + 4);
+        auto miscFlags = read<uint32_t>(file, DDS_HEADER_END + 8);
+        auto arraySize = read<uint32_t>(file, DDS_HEADER_END + 12);
+        if (dimension != DDS_DIMENSION_TEXTURE2D || (miscFlags & DDS_MISC_TEXTURECUBE) ||
+            arraySize > 1) {
+            throw std::runtime_error("Only single 2D textures are supported");
+        }
+        dataOffset += DDS_DX10_HEADER_SIZE;
+    } else if (fourCC == makeFourCC('D', 'X', 'T', '1')) {
+        // Legacy headers carry no color space. Textures loaded here are colors, so sRGB
+        texture.format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    } else if (fourCC == makeFourCC('D', 'X', 'T', '5')) {
+        texture.format = VK_FORMAT_BC3_SRGB_BLOCK;
+    }
+    if (!isSupportedFormat(texture.format)) {
+        throw std::runtime_error("DDS file is not BC1, BC3 or BC7");
+    }
+    checkExtent(texture);
+
+    // Levels follow the header largest first and tightly packed, just like the upload wants
+    auto total = getChainSize(texture);
+    if (file.size() < dataOffset || file.size() - dataOffset < total) {
+        throw std::runtime_error("Texture file is truncated");
+    }
+    texture.levels.resize(total);
+    memcpy(texture.levels.data(), file.data() + dataOffset, total);
+    return texture;
+}
+} // namespace
+
+std::optional<CompressedTexture> parseTextureContainer(std::span<const std::byte> file)
+{
+    if (file.size() >= KTX2_IDENTIFIER.size() &&
+        std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), file.begin(),
+            [](unsigned char expected, std::byte actual) {
+                return std::byte{expected} == actual;
+            })) {
+        return parseKtx2(file);
+    }
+    if (file.size() >= 4 && read<uint32_t>(file, 0) == makeFourCC('D', 'D', 'S', ' ')) {
+        if (file.size() < DDS_HEADER_END) {
+            throw std::runtime_error("Texture file is truncated");
+        }
+        return parseDds(file);
+    }
+    return std::nullopt;
+}
+
+} // namespace VaryZulu::Gfx
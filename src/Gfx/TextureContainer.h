@@ -0,0 +1,29 @@
+#pragma once
+
+#include "vk_wrap.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Texture stored ready for the GPU, with every level packed back to back, largest first
+struct CompressedTexture
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipLevels = 1;
+    std::vector<unsigned char> levels;
+};
+
+// Reads a single 2D texture in BC1, BC3 or BC7 from a KTX2 or DDS file. Returns nothing for
+// files in neither container, so they can go to an image decoder instead. Throws for
+// containers that are malformed or hold something else, like cube maps, arrays or
+// supercompressed data
+std::optional<CompressedTexture> parseTextureContainer(std::span<const std::byte> file);
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,150 @@
+#include "TextureFormats.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+TexelBlock getTexelBlock(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return TexelBlock{.extent = 1, .bytes = 4};
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            return TexelBlock{.extent = 4, .bytes = 8};
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return TexelBlock{.extent = 4, .bytes = 16};
+        default:
+            throw std::runtime_error("Unsupported texture format");
+    }
+}
+
+VkDeviceSize getImageLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    auto block = getTexelBlock(format);
+    // Partial blocks at the right and bottom edges are stored whole
+    VkDeviceSize blocksWide = std::max(1u, (width + block.extent - 1) / block.extent);
+    VkDeviceSize blocksHigh = std::max(1u, (height + block.extent - 1) / block.extent);
+    return blocksWide * blocksHigh * block.bytes;
+}
+
+bool isBlockCompressed(VkFormat format)
+{
+    return getTexelBlock(format).extent > 1;
+}
+
+const char* getFormatName(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return "RGBA8";
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            return "BC1";
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            return "BC3";
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return "BC7";
+        case VK_FORMAT_D16_UNORM:
+            return "D16";
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+            return "X8D24";
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+            return "D24S8";
+        case VK_FORMAT_D32_SFLOAT:
+            return "D32F";
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return "D32FS8";
+        default:
+            return "unknown";
+    }
+}
+
+uint32_t getMipLevelCount(uint32_t width, uint32_t height)
+{
+    return static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+}
+
+std::vector<unsigned char> buildMipChain(
+    const unsigned char* base, uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+    static const auto toLinear = [] {
+        std::array<float, 256> table{};
+        for (size_t i = 0; i < table.size(); ++i) {
+            auto c = static_cast<float>(i) / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+    auto toSrgb = [](float linear) {
+        auto c = linear <= 0.0031308f ? linear * 12.92f
+                                      : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+        return static_cast<unsigned char>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+    };
+
+    size_t total = 0;
+    for (uint32_t mip = 0; mip < mipLevels; ++mip) {
+        total += size_t{std::max(1u, width >> mip)} * std::max(1u, height >> mip) * 4;
+    }
+    std::vector<unsigned char> chain(total);
+    memcpy(chain.data(), base, size_t{width} * height * 4);
+
+    size_t srcOffset = 0;
+    size_t dstOffset = size_t{width} * height * 4;
+    for (uint32_t mip = 1; mip < mipLevels; ++mip) {
+        auto srcWidth = std::max(1u, width >> (mip - 1));
+        auto srcHeight = std::max(1u, height >> (mip - 1));
+        auto dstWidth = std::max(1u, width >> mip);
+        auto dstHeight = std::max(1u, height >> mip);
+        const auto* src = chain.data() + srcOffset;
+        auto* dst = chain.data() + dstOffset;
+        for (uint32_t y = 0; y < dstHeight; ++y) {
+            for (uint32_t x = 0; x < dstWidth; ++x) {
+                // A 1 texel wide source repeats its edge instead of reading past it
+                std::array<size_t, 4> texels{};
+                auto x0 = x * 2;
+                auto y0 = y * 2;
+                auto x1 = std::min(x0 + 1, srcWidth - 1);
+                auto y1 = std::min(y0 + 1, srcHeight - 1);
+                texels[0] = (size_t{y0} * srcWidth + x0) * 4;
+                texels[1] = (size_t{y0} * srcWidth + x1) * 4;
+                texels[2] = (size_t{y1} * srcWidth + x0) * 4;
+                texels[3] = (size_t{y1} * srcWidth + x1) * 4;
+                auto* out = dst + (size_t{y} * dstWidth + x) * 4;
+                for (size_t channel = 0; channel < 3; ++channel) {
+                    float sum = 0.0f;
+                    for (auto texel : texels) {
+                        sum += toLinear[src[texel + channel]];
+                    }
+                    out[channel] = toSrgb(sum * 0.25f);
+                }
+                unsigned alpha = 0;
+                for (auto texel : texels) {
+                    alpha += src[texel + 3];
+                }
+                out[3] = static_cast<unsigned char>((alpha + 2) / 4);
+            }
+        }
+        srcOffset = dstOffset;
+        dstOffset += size_t{dstWidth} * dstHeight * 4;
+    }
+    return chain;
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Smallest addressable unit of a texture format. Block compressed formats store 4x4 texel
+// blocks, the uncompressed ones single texels
+struct TexelBlock
+{
+    uint32_t extent = 1;
+    uint32_t bytes = 4;
+};
+
+// Throws for formats textures are never stored in
+TexelBlock getTexelBlock(VkFormat format);
+VkDeviceSize getImageLevelSize(VkFormat format, uint32_t width, uint32_t height);
+bool isBlockCompressed(VkFormat format);
+const char* getFormatName(VkFormat format);
+
+// Levels down to 1x1
+uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+// Box filters RGBA8 sRGB level 0 down to 1x1. Color is averaged in linear space so minified
+// textures don't darken, alpha is averaged as is. Levels are packed back to back
+std::vector<unsigned char> buildMipChain(
+    const unsigned char* base, uint32_t width, uint32_t height, uint32_t mipLevels);
+
+} // namespace VaryZulu::Gfx
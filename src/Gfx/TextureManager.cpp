@@ -0,0 +1,345 @@
+#include "TextureManager.h"
+#include "TextureContainer.h"
+#include "TextureFormats.h"
+#include "Utils/Trace.h"
+#include "Utils/Utils.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+// 64-bit FNV-1a. Collisions between real texture files are not a practical concern
+uint64_t hashBytes(std::span<const std::byte> data)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (auto byte : data) {
+        hash ^= static_cast<uint64_t>(byte);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+} // namespace
+
+void TextureManager::PixelsDeleter::operator()(unsigned char* pixels) const
+{
+    stbi_image_free(pixels);
+}
+
+void TextureManager::init(VkPhysicalDevice physicalDevice, VkDevice logicalDevice,
+    MemoryAllocator& memoryAllocator, UploadManager& uploadManager,
+    const std::vector<uint32_t>& queueFamilies, size_t decodeThreadCount,
+    bool textureCompressionBC)
+{
+    device = logicalDevice;
+    allocator = &memoryAllocator;
+    uploads = &uploadManager;
+    sharedQueueFamilies = queueFamilies;
+
+    VkFormatProperties formatProperties{};
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, FORMAT, &formatProperties);
+    constexpr VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                                  VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    gpuMips = uploads->canBlit() &&
+              (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+    if (textureCompressionBC) {
+        for (auto format : {VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK,
+                 VK_FORMAT_BC1_RGBA_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_SRGB_BLOCK,
+                 VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, VK_FORMAT_BC7_UNORM_BLOCK,
+                 VK_FORMAT_BC7_SRGB_BLOCK}) {
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+            if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) {
+                compressedFormats.push_back(format);
+            }
+        }
+    }
+    decodeThreads = std::make_unique<Utils::ThreadPool>(decodeThreadCount);
+
+    constexpr std::array<unsigned char, 4> white{255, 255, 255, 255};
+    placeholder = createImage(FORMAT, 1, 1, 1, white.data(), white.size(), false);
+    spdlog::info("Texture manager: {} decode threads, mipmaps built on the {}, {} of 8 BC "
+                 "formats supported",
+        decodeThreadCount, gpuMips ? "GPU" : "CPU", compressedFormats.size());
+}
+
+void TextureManager::destroy()
+{
+    // Joins the workers. Running decodes finish, queued ones are dropped
+    decodeThreads.reset();
+    decoded.clear();
+    waitingForFirst.clear();
+    for (auto& image : images) {
+        destroyImage(image);
+    }
+    images.clear();
+    destroyImage(placeholder);
+}
+
+TextureHandle TextureManager::load(const std::string& path)
+{
+    auto found = texturesByPath.find(path);
+    if (found != texturesByPath.end()) {
+        return found->second;
+    }
+    auto texture = static_cast<TextureHandle>(textureImages.size());
+    textureImages.push_back(NO_IMAGE);
+    texturesByPath.emplace(path, texture);
+    ++pendingCount;
+    decodeThreads->enqueue([this, texture, path] { decode(texture, path); });
+    return texture;
+}
+
+TextureHandle TextureManager::create(const std::string& name, VkFormat format, uint32_t width,
+    uint32_t height, uint32_t mipLevels, std::span<const std::byte> levels)
+{
+    auto found = texturesByPath.find(name);
+    if (found != texturesByPath.end()) {
+        return found->second;
+    }
+    auto texture = static_cast<TextureHandle>(textureImages.size());
+    textureImages.push_back(NO_IMAGE);
+    texturesByPath.emplace(name, texture);
+    if (isBlockCompressed(format) &&
+        std::find(compressedFormats.begin(), compressedFormats.end(), format) ==
+            compressedFormats.end()) {
+        spdlog::error("Failed to load texture {}: {} textures are not supported by the device",
+            name, getFormatName(format));
+        return texture;
+    }
+    auto image = static_cast<uint32_t>(images.size());
+    images.push_back(
+        createImage(format, width, height, mipLevels, levels.data(), levels.size(), false));
+    textureImages[texture] = image;
+    unflushed.push_back(image);
+    return texture;
+}
+
+void TextureManager::decode(TextureHandle texture, const std::string& path)
+{
+    VZ_TRACE_SCOPE("Decode texture");
+    Decoded result{.texture = texture};
+    try {
+        auto mapped = Utils::readFile(path);
+        auto file = mapped.getData();
+        result.hash = hashBytes(file);
+        {
+            std::lock_guard lock(mutex);
+            result.decodedHere = claimedHashes.insert(result.hash).second;
+        }
+        if (result.decodedHere) {
+            if (auto container = parseTextureContainer(file)) {
+                if (std::find(compressedFormats.begin(), compressedFormats.end(),
+                        container->format) == compressedFormats.end()) {
+                    throw std::runtime_error(std::string{getFormatName(container->format)} +
+                                             " textures are not supported by the device");
+                }
+                result.format = container->format;
+                result.width = container->width;
+                result.height = container->height;
+                result.mipLevels = container->mipLevels;
+                result.mipChain = std::move(container->levels);
+            } else {
+                decodeImage(result, file, path);
+            }
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to load texture {}: {}", path, e.what());
+        result.failed = true;
+    }
+    std::lock_guard lock(mutex);
+    decoded.push_back(std::move(result));
+}
+
+void TextureManager::decodeImage(
+    Decoded& result, std::span<const std::byte> file, const std::string& path) const
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    result.pixels.reset(stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file.data()),
+        static_cast<int>(file.size()), &width, &height, &channels, STBI_rgb_alpha));
+    if (!result.pixels) {
+        spdlog::error("Failed to decode texture {}: {}", path, stbi_failure_reason());
+        result.failed = true;
+        return;
+    }
+    result.width = static_cast<uint32_t>(width);
+    result.height = static_cast<uint32_t>(height);
+    result.mipLevels = getMipLevelCount(result.width, result.height);
+    if (!gpuMips) {
+        VZ_TRACE_SCOPE("Build mip chain");
+        result.mipChain =
+            buildMipChain(result.pixels.get(), result.width, result.height, result.mipLevels);
+        result.pixels.reset();
+    }
+}
+
+void TextureManager::update()
+{
+    VZ_TRACE_SCOPE("Update textures");
+    for (auto it = uploading.begin(); it != uploading.end();) {
+        auto& image = images[*it];
+        if (uploads->isComplete(image.ticket)) {
+            image.resident = true;
+            ++version;
+            it = uploading.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<Decoded> ready;
+    {
+        std::lock_guard lock(mutex);
+        VkDeviceSize budget = 0;
+        while (!decoded.empty() && budget < UPLOAD_BUDGET) {
+            const auto& front = decoded.front();
+            budget += front.pixels ? VkDeviceSize{front.width} * front.height * 4
+                                   : front.mipChain.size();
+            ready.push_back(std::move(decoded.front()));
+            decoded.pop_front();
+        }
+    }
+    auto recorded = std::move(unflushed);
+    unflushed.clear();
+    for (auto& result : ready) {
+        resolve(result, recorded);
+    }
+    // Duplicates can arrive before the copy that decodes their contents
+    for (auto it = waitingForFirst.begin(); it != waitingForFirst.end();) {
+        if (imagesByHash.contains(it->hash)) {
+            resolve(*it, recorded);
+            it = waitingForFirst.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (!recorded.empty()) {
+        auto ticket = uploads->flush();
+        for (auto idx : recorded) {
+            images[idx].ticket = ticket;
+            uploading.push_back(idx);
+        }
+    }
+}
+
+void TextureManager::resolve(Decoded& result, std::vector<uint32_t>& recorded)
+{
+    uint32_t image = NO_IMAGE;
+    if (result.decodedHere) {
+        if (!result.failed) {
+            VZ_TRACE_SCOPE("Upload texture");
+            image = static_cast<uint32_t>(images.size());
+            if (result.pixels) {
+                images.push_back(createImage(result.format, result.width, result.height,
+                    result.mipLevels, result.pixels.get(),
+                    VkDeviceSize{result.width} * result.height * 4, true));
+            } else {
+                images.push_back(createImage(result.format, result.width, result.height,
+                    result.mipLevels, result.mipChain.data(), result.mipChain.size(), false));
+            }
+            recorded.push_back(image);
+            result.pixels.reset();
+            result.mipChain = {};
+        }
+        imagesByHash[result.hash] = image;
+    } else if (!result.failed) {
+        auto found = imagesByHash.find(result.hash);
+        if (found == imagesByHash.end()) {
+            waitingForFirst.push_back(std::move(result));
+            return;
+        }
+        image = found->second;
+    }
+    textureImages[result.texture] = image;
+    --pendingCount;
+    if (image != NO_IMAGE && images[image].resident) {
+        ++version;
+    }
+}
+
+TextureManager::Image TextureManager::createImage(VkFormat format, uint32_t width,
+    uint32_t height, uint32_t mipLevels, const void* pixels, VkDeviceSize size, bool generateMips)
+{
+    Image image;
+    VkImageCreateInfo imageInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = VkExtent3D{.width = width, .height = height, .depth = 1},
+        .mipLevels = mipLevels,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        // Blits read the previous level of the image itself
+        .usage = (generateMips ? VkImageUsageFlags{VK_IMAGE_USAGE_TRANSFER_SRC_BIT} : 0) |
+                 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    if (sharedQueueFamilies.size() > 1) {
+        // Written on the transfer queue, read on the graphics queue
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharedQueueFamilies.size());
+        imageInfo.pQueueFamilyIndices = sharedQueueFamilies.data();
+    }
+    auto res = vkCreateImage(device, &imageInfo, nullptr, &image.image);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image");
+    }
+    VkMemoryRequirements requirements{};
+    vkGetImageMemoryRequirements(device, image.image, &requirements);
+    image.memory = allocator->allocate(
+        requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceKind::Optimal);
+    vkBindImageMemory(device, image.image, image.memory.memory, image.memory.offset);
+    // Block compressed textures take a quarter to an eighth of the memory of RGBA8
+    spdlog::debug("Texture image {}x{} {} with {} levels: {} KiB", width, height,
+        getFormatName(format), mipLevels, requirements.size / 1024);
+
+    VkImageViewCreateInfo viewInfo{.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = image.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .subresourceRange = VkImageSubresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = mipLevels,
+            .baseArrayLayer = 0,
+            .layerCount = 1}};
+    res = vkCreateImageView(device, &viewInfo, nullptr, &image.view);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image view");
+    }
+
+    uploads->uploadImage(
+        image.image, format, width, height, mipLevels, pixels, size, generateMips);
+    return image;
+}
+
+void TextureManager::destroyImage(Image& image)
+{
+    vkDestroyImageView(device, image.view, nullptr);
+    vkDestroyImage(device, image.image, nullptr);
+    allocator->free(image.memory);
+    image = Image{};
+}
+
+VkImageView TextureManager::getView(TextureHandle texture) const
+{
+    return isResident(texture) ? images[textureImages[texture]].view : placeholder.view;
+}
+
+bool TextureManager::isResident(TextureHandle texture) const
+{
+    auto image = textureImages[texture];
+    return image != NO_IMAGE && images[image].resident;
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
+#include "Utils/ThreadPool.h"
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+using TextureHandle = uint32_t;
+
+// Loads textures asynchronously. Files are read, hashed and decoded on worker threads, then
+// uploaded from update() on the render thread. Files with the same contents share one image.
+// A handle is valid right away and resolves to a 1x1 white placeholder until its image is
+// resident. A texture that fails to load keeps the placeholder. Images decoded with stb get a
+// full mip chain, blitted on the GPU when the upload queue and format allow it and box filtered
+// on the decode workers otherwise. KTX2 and DDS files with BC1, BC3 or BC7 blocks are uploaded
+// as stored, with their own mips.
+class TextureManager
+{
+public:
+    // Records the placeholder upload, which the caller's next flush submits. BC textures load
+    // only with the textureCompressionBC feature enabled on the device
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator,
+        UploadManager& uploads, const std::vector<uint32_t>& sharedQueueFamilies,
+        size_t decodeThreads, bool textureCompressionBC);
+    void destroy();
+
+    // Loading the same path twice returns the same handle
+    TextureHandle load(const std::string& path);
+    // Uploads levels that are already in their final format, packed back to back, largest
+    // first, without going through the decode workers. The data is only read during the call.
+    // Loading name afterwards returns the same handle
+    TextureHandle create(const std::string& name, VkFormat format, uint32_t width,
+        uint32_t height, uint32_t mipLevels, std::span<const std::byte> levels);
+    // Uploads decoded textures and publishes finished uploads. Render thread only
+    void update();
+
+    VkImageView getView(TextureHandle texture) const;
+    bool isResident(TextureHandle texture) const;
+
+    // Changes whenever a handle starts resolving to another view, so descriptors can be
+    // refreshed only when needed
+    uint64_t getVersion() const
+    {
+        return version;
+    }
+
+    // Loads that are neither resident nor failed yet
+    size_t getPendingCount() const
+    {
+        return pendingCount;
+    }
+
+private:
+    static constexpr uint32_t NO_IMAGE = ~0u;
+    static constexpr VkFormat FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+    // Caps the texel data uploaded per update() so a burst of decodes can't stall a frame
+    static constexpr VkDeviceSize UPLOAD_BUDGET = 16ull * 1024 * 1024;
+
+    struct PixelsDeleter
+    {
+        void operator()(unsigned char* pixels) const;
+    };
+    using Pixels = std::unique_ptr<unsigned char, PixelsDeleter>;
+
+    // Result of a worker. Only the first load of some content decodes it, later loads of the
+    // same content come back without pixels and are pointed at the first one's image
+    struct Decoded
+    {
+        TextureHandle texture = 0;
+        uint64_t hash = 0;
+        bool decodedHere = false;
+        bool failed = false;
+        VkFormat format = FORMAT;
+        // Level 0 as decoded, or empty when mipChain holds every level, built on the CPU or
+        // read from a container
+        Pixels pixels;
+        std::vector<unsigned char> mipChain;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 1;
+    };
+
+    struct Image
+    {
+        VkImage image = nullptr;
+        Allocation memory;
+        VkImageView view = nullptr;
+        UploadTicket ticket = 0;
+        bool resident = false;
+    };
+
+    void decode(TextureHandle texture, const std::string& path);
+    // Decodes a PNG, JPEG or other stb format, building the mips too when the GPU can't
+    void decodeImage(
+        Decoded& result, std::span<const std::byte> file, const std::string& path) const;
+    void resolve(Decoded& result, std::vector<uint32_t>& recorded);
+    // Creates the image and view and records the upload. Without generateMips pixels holds
+    // every level
+    Image createImage(VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels,
+        const void* pixels, VkDeviceSize size, bool generateMips);
+    void destroyImage(Image& image);
+
+    VkDevice device = nullptr;
+    MemoryAllocator* allocator = nullptr;
+    UploadManager* uploads = nullptr;
+    std::vector<uint32_t> sharedQueueFamilies;
+    std::unique_ptr<Utils::ThreadPool> decodeThreads;
+    // Set in init, before any worker runs
+    bool gpuMips = false;
+    std::vector<VkFormat> compressedFormats;
+
+    // Render thread state
+    Image placeholder;
+    std::vector<uint32_t> textureImages;
+    std::unordered_map<std::string, TextureHandle> texturesByPath;
+    std::vector<Image> images;
+    std::unordered_map<uint64_t, uint32_t> imagesByHash;
+    std::vector<uint32_t> uploading;
+    // Recorded by create(), submitted by the next update()
+    std::vector<uint32_t> unflushed;
+    // Duplicates whose first copy hasn't been resolved yet
+    std::vector<Decoded> waitingForFirst;
+    uint64_t version = 0;
+    size_t pendingCount = 0;
+
+    // Shared with the workers
+    std::mutex mutex;
+    std::unordered_set<uint64_t> claimedHashes;
+    std::deque<Decoded> decoded;
+};
+
+} // namespace VaryZulu::Gfx
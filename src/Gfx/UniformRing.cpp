@@ -0,0 +1,55 @@
+#include "UniformRing.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+namespace
+{
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+void UniformRing::init(MemoryAllocator& allocator, VkDeviceSize minAlignment, uint32_t frameCount,
+    VkDeviceSize requestedFrameSize)
+{
+    alignment = minAlignment > 0 ? minAlignment : 1;
+    frameSize = alignUp(requestedFrameSize, alignment);
+    allocator.createBuffer(frameSize * frameCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer,
+        memory);
+    frameBegin = 0;
+    head = 0;
+    spdlog::debug("Uniform ring: {} frames of {} KB, alignment {}", frameCount, frameSize / 1024,
+        alignment);
+}
+
+void UniformRing::destroy(MemoryAllocator& allocator)
+{
+    allocator.destroyBuffer(buffer, memory);
+}
+
+void UniformRing::beginFrame(uint32_t frame)
+{
+    frameBegin = frame * frameSize;
+    head = frameBegin;
+}
+
+uint32_t UniformRing::push(const void* data, VkDeviceSize size)
+{
+    if (head + size > frameBegin + frameSize) {
+        spdlog::error("Uniform ring frame slice of {} bytes exhausted", frameSize);
+        throw std::runtime_error("Uniform ring overflow");
+    }
+    auto offset = head;
+    memcpy(static_cast<char*>(memory.mapped) + offset, data, static_cast<size_t>(size));
+    head = alignUp(head + size, alignment);
+    return static_cast<uint32_t>(offset);
+}
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+
+namespace VaryZulu::Gfx
+{
+// One persistently mapped, host-coherent uniform buffer split into a slice per frame.
+// Each push() appends to the current frame's slice and returns the offset to pass as a
+// dynamic offset for a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC binding.
+class UniformRing
+{
+public:
+    void init(MemoryAllocator& allocator, VkDeviceSize minAlignment, uint32_t frameCount,
+        VkDeviceSize frameSize);
+    void destroy(MemoryAllocator& allocator);
+
+    // Rewinds the slice of the given frame. Caller guarantees the GPU is done with it
+    void beginFrame(uint32_t frame);
+    uint32_t push(const void* data, VkDeviceSize size);
+
+    template <typename T>
+    uint32_t push(const T& value)
+    {
+        return push(&value, sizeof(T));
+    }
+
+    VkBuffer getBuffer() const
+    {
+        return buffer;
+    }
+
+    // Offset of the first push in a frame's slice. Stable for the lifetime of the ring
+    uint32_t getFrameOffset(uint32_t frame) const
+    {
+        return static_cast<uint32_t>(frame * frameSize);
+    }
+
+private:
+    VkBuffer buffer = nullptr;
+    Allocation memory;
+    VkDeviceSize alignment = 0;
+    VkDeviceSize frameSize = 0;
+    VkDeviceSize frameBegin = 0;
+    VkDeviceSize head = 0;
+};
+
+} // namespace VaryZulu::Gfx
@@ -0,0 +1,328 @@
+#include "UploadManager.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace VaryZulu::Gfx
+{
+void UploadManager::init(VkDevice logicalDevice, MemoryAllocator& memoryAllocator,
+    uint32_t family, VkQueue transferQueue, bool isGraphicsQueue, VkDeviceSize stagingSize)
+{
+    device = logicalDevice;
+    allocator = &memoryAllocator;
+    queueFamily = family;
+    queue = transferQueue;
+    graphicsQueue = isGraphicsQueue;
+
+    VkCommandPoolCreateInfo poolInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queueFamily};
+    auto res = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload command pool");
+    }
+    staging.init(*allocator, stagingSize);
+    spdlog::info("Uploads use queue family {}{}", queueFamily,
+        graphicsQueue ? " (shared with graphics)" : " (dedicated transfer)");
+}
+
+void UploadManager::destroy()
+{
+    if (recording.commandBuffer) {
+        flush();
+    }
+    wait(lastSubmitted);
+    collect();
+    staging.destroy(*allocator);
+    vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+VkCommandBuffer UploadManager::getCommandBuffer()
+{
+    if (recording.commandBuffer) {
+        return recording.commandBuffer;
+    }
+    VkCommandBufferAllocateInfo allocInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1};
+    auto res = vkAllocateCommandBuffers(device, &allocInfo, &recording.commandBuffer);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed allocating upload command buffer");
+    }
+    VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+    vkBeginCommandBuffer(recording.commandBuffer, &beginInfo);
+    return recording.commandBuffer;
+}
+
+VkDeviceSize UploadManager::stage(const void* data, VkDeviceSize size)
+{
+    auto offset = staging.allocate(size, STAGING_ALIGNMENT, lastSubmitted + 1);
+    while (!offset.has_value()) {
+        if (staging.isEmpty()) {
+            spdlog::error("Upload chunk of {} bytes doesn't fit the staging ring", size);
+            throw std::runtime_error("Staging ring too small");
+        }
+        // Ring is full: push out what we have and reuse the space of the oldest batch
+        if (recording.commandBuffer && inFlight.empty()) {
+            flush();
+        }
+        waitOldest();
+        offset = staging.allocate(size, STAGING_ALIGNMENT, lastSubmitted + 1);
+    }
+    memcpy(staging.getMapped(offset.value()), data, static_cast<size_t>(size));
+    return offset.value();
+}
+
+void UploadManager::waitOldest()
+{
+    if (inFlight.empty()) {
+        return;
+    }
+    auto oldest = std::min_element(inFlight.begin(), inFlight.end(),
+        [](const auto& a, const auto& b) { return a.ticket < b.ticket; });
+    vkWaitForFences(device, 1, &oldest->fence, VK_TRUE, UINT64_MAX);
+    collect();
+}
+
+void UploadManager::uploadBuffer(
+    VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+    auto chunkSize = staging.getCapacity() / 2;
+    auto bytes = static_cast<const char*>(data);
+    for (VkDeviceSize done = 0; done < size; done += chunkSize) {
+        auto chunk = std::min(chunkSize, size - done);
+        auto srcOffset = stage(bytes + done, chunk);
+        VkBufferCopy copyRegion{
+            .srcOffset = srcOffset, .dstOffset = dstOffset + done, .size = chunk};
+        vkCmdCopyBuffer(getCommandBuffer(), staging.getBuffer(), dst, 1, &copyRegion);
+    }
+}
+
+void UploadManager::uploadImage(VkImage dst, VkFormat format, uint32_t width, uint32_t height,
+    uint32_t mipLevels, const void* data, VkDeviceSize size, bool generateMips)
+{
+    if (generateMips && (!canBlit() || isBlockCompressed(format))) {
+        throw std::runtime_error("Mip generation needs a graphics upload queue and an "
+                                 "uncompressed format");
+    }
+    auto levelsInData = generateMips ? 1 : mipLevels;
+    VkDeviceSize expectedSize = 0;
+    for (uint32_t mip = 0; mip < levelsInData; ++mip) {
+        expectedSize += getImageLevelSize(
+            format, std::max(1u, width >> mip), std::max(1u, height >> mip));
+    }
+    if (size != expectedSize) {
+        throw std::runtime_error("Image data size doesn't match its levels");
+    }
+    transitionImageLayout(getCommandBuffer(), dst, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, mipLevels);
+
+    auto block = getTexelBlock(format);
+    auto bytes = static_cast<const char*>(data);
+    for (uint32_t mip = 0; mip < levelsInData; ++mip) {
+        auto mipWidth = std::max(1u, width >> mip);
+        auto mipHeight = std::max(1u, height >> mip);
+        copyImageLevel(dst, mip, mipWidth, mipHeight, bytes, block);
+        bytes += getImageLevelSize(format, mipWidth, mipHeight);
+    }
+
+    if (generateMips && mipLevels > 1) {
+        generateMipmaps(dst, width, height, mipLevels);
+    } else {
+        transitionImageLayout(getCommandBuffer(), dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, mipLevels);
+    }
+}
+
+void UploadManager::copyImageLevel(VkImage dst, uint32_t mipLevel, uint32_t width,
+    uint32_t height, const char* data, TexelBlock block)
+{
+    // Split by whole block rows so every chunk is a plain rectangular copy. Only the last chunk
+    // may end in a partial block row, at the bottom edge where the copy extent may be uneven
+    auto blockRows = (height + block.extent - 1) / block.extent;
+    VkDeviceSize rowSize = VkDeviceSize{(width + block.extent - 1) / block.extent} * block.bytes;
+    auto rowsPerChunk = static_cast<uint32_t>(std::min<VkDeviceSize>(
+        blockRows, std::max<VkDeviceSize>(1, staging.getCapacity() / 2 / rowSize)));
+    for (uint32_t blockRow = 0; blockRow < blockRows; blockRow += rowsPerChunk) {
+        auto chunkRows = std::min(rowsPerChunk, blockRows - blockRow);
+        auto row = blockRow * block.extent;
+        auto rows = std::min(chunkRows * block.extent, height - row);
+        auto srcOffset = stage(data + blockRow * rowSize, chunkRows * rowSize);
+        VkBufferImageCopy region{.bufferOffset = srcOffset,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = VkImageSubresourceLayers{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = mipLevel,
+                .baseArrayLayer = 0,
+                .layerCount = 1},
+            .imageOffset = VkOffset3D{.x = 0, .y = static_cast<int32_t>(row), .z = 0},
+            .imageExtent = VkExtent3D{.width = width, .height = rows, .depth = 1}};
+        // Staging may have flushed the previous batch, always record into the current one
+        vkCmdCopyBufferToImage(getCommandBuffer(), staging.getBuffer(), dst,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+}
+
+void UploadManager::generateMipmaps(
+    VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+    // No staging from here on, so everything lands in the same command buffer
+    auto commandBuffer = getCommandBuffer();
+    auto colorLevel = [](uint32_t mip) {
+        return VkImageSubresourceLayers{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = mip,
+            .baseArrayLayer = 0,
+            .layerCount = 1};
+    };
+    auto mipWidth = static_cast<int32_t>(width);
+    auto mipHeight = static_cast<int32_t>(height);
+    for (uint32_t mip = 1; mip < mipLevels; ++mip) {
+        transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mip - 1);
+        auto nextWidth = std::max(1, mipWidth / 2);
+        auto nextHeight = std::max(1, mipHeight / 2);
+        VkImageBlit blit{.srcSubresource = colorLevel(mip - 1),
+            .srcOffsets = {VkOffset3D{0, 0, 0}, VkOffset3D{mipWidth, mipHeight, 1}},
+            .dstSubresource = colorLevel(mip),
+            .dstOffsets = {VkOffset3D{0, 0, 0}, VkOffset3D{nextWidth, nextHeight, 1}}};
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        // The source level is final now
+        transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mip - 1);
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+    transitionImageLayout(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels - 1);
+}
+
+void UploadManager::transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
+    VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t baseMipLevel, uint32_t levelCount)
+{
+    VkImageMemoryBarrier barrier{.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = 0,
+        .oldLayout = oldLayout,
+        .newLayout = newLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = VkImageSubresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = baseMipLevel,
+            .levelCount = levelCount,
+            .baseArrayLayer = 0,
+            .layerCount = 1}};
+
+    VkPipelineStageFlags sourceStage;
+    VkPipelineStageFlags destStage;
+
+    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+        newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        destStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
+               newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        // The level was just written by a copy or a blit and is read by the next blit
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL &&
+               newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        // Only blits read a TRANSFER_SRC level, and those need a graphics queue
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        destStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
+               newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        if (graphicsQueue) {
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            destStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        } else {
+            // A transfer-only queue can't name shader stages. The graphics queue only samples
+            // the image after the batch fence has signaled
+            barrier.dstAccessMask = 0;
+            destStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
+    } else {
+        throw std::runtime_error("Unsupported layout transition");
+    }
+    vkCmdPipelineBarrier(
+        commandBuffer, sourceStage, destStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+UploadTicket UploadManager::flush()
+{
+    if (!recording.commandBuffer) {
+        return lastSubmitted;
+    }
+    vkEndCommandBuffer(recording.commandBuffer);
+
+    VkFenceCreateInfo fenceInfo{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    auto res = vkCreateFence(device, &fenceInfo, nullptr, &recording.fence);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upload fence");
+    }
+
+    VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &recording.commandBuffer};
+    res = vkQueueSubmit(queue, 1, &submitInfo, recording.fence);
+    if (res != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit uploads");
+    }
+    recording.ticket = ++lastSubmitted;
+    spdlog::debug("Submitted upload batch {}", recording.ticket);
+    inFlight.push_back(std::move(recording));
+    recording = Batch{};
+    return lastSubmitted;
+}
+
+bool UploadManager::isComplete(UploadTicket ticket)
+{
+    if (ticket > lastCompleted) {
+        collect();
+    }
+    return ticket <= lastCompleted;
+}
+
+void UploadManager::wait(UploadTicket ticket)
+{
+    for (auto& batch : inFlight) {
+        if (batch.ticket <= ticket) {
+            vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+        }
+    }
+    collect();
+}
+
+void UploadManager::collect()
+{
+    auto firstPending = std::partition(inFlight.begin(), inFlight.end(),
+        [this](const auto& batch) { return vkGetFenceStatus(device, batch.fence) == VK_SUCCESS; });
+    for (auto it = inFlight.begin(); it != firstPending; ++it) {
+        vkFreeCommandBuffers(device, commandPool, 1, &it->commandBuffer);
+        vkDestroyFence(device, it->fence, nullptr);
+    }
+    inFlight.erase(inFlight.begin(), firstPending);
+
+    // Batches go through a single queue, so everything older than the oldest pending batch is done
+    lastCompleted = lastSubmitted;
+    for (const auto& batch : inFlight) {
+        lastCompleted = std::min(lastCompleted, batch.ticket - 1);
+    }
+    staging.release(lastCompleted);
+}
+
+} // namespace VaryZulu::Gfx
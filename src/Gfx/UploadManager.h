@@ -0,0 +1,91 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "TextureFormats.h"
+
+#include "vk_wrap.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace VaryZulu::Gfx
+{
+// Monotonic id of a submitted upload batch. 0 is always complete
+using UploadTicket = uint64_t;
+
+// Records staging copies into one command buffer per batch and submits them on a transfer
+// queue without waiting. Callers poll isComplete() with the ticket returned by flush().
+// All data goes through one staging ring; uploads larger than a chunk are split.
+class UploadManager
+{
+public:
+    void init(VkDevice device, MemoryAllocator& allocator, uint32_t queueFamily, VkQueue queue,
+        bool graphicsQueue, VkDeviceSize stagingSize);
+    void destroy();
+
+    void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+    // Uploads mipLevels levels packed back to back in data, largest first, and leaves the image
+    // in SHADER_READ_ONLY_OPTIMAL. Block compressed levels are copied as is. With generateMips
+    // data only holds level 0 and the others are blitted from it, which needs canBlit() and an
+    // uncompressed format with linear filtering support
+    void uploadImage(VkImage dst, VkFormat format, uint32_t width, uint32_t height,
+        uint32_t mipLevels, const void* data, VkDeviceSize size, bool generateMips = false);
+
+    // Submits everything recorded since the last flush
+    UploadTicket flush();
+    bool isComplete(UploadTicket ticket);
+    void wait(UploadTicket ticket);
+    // Releases staging memory and command buffers of finished batches
+    void collect();
+
+    uint32_t getQueueFamily() const
+    {
+        return queueFamily;
+    }
+
+    // vkCmdBlitImage needs a graphics queue
+    bool canBlit() const
+    {
+        return graphicsQueue;
+    }
+
+private:
+    // Keeps texel rows and compressed blocks aligned for vkCmdCopyBufferToImage
+    static constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+    struct Batch
+    {
+        UploadTicket ticket = 0;
+        VkCommandBuffer commandBuffer = nullptr;
+        VkFence fence = nullptr;
+    };
+
+    VkCommandBuffer getCommandBuffer();
+    // Copies data into the staging ring, flushing and waiting for old batches if it is full
+    VkDeviceSize stage(const void* data, VkDeviceSize size);
+    void waitOldest();
+    // Copies one mip level in chunks of whole rows of texel blocks
+    void copyImageLevel(VkImage dst, uint32_t mipLevel, uint32_t width, uint32_t height,
+        const char* data, TexelBlock block);
+    // Fills levels 1 and up by repeatedly halving the previous level
+    void generateMipmaps(VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels);
+    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image,
+        VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t baseMipLevel = 0,
+        uint32_t levelCount = 1);
+
+    VkDevice device = nullptr;
+    MemoryAllocator* allocator = nullptr;
+    uint32_t queueFamily = 0;
+    VkQueue queue = nullptr;
+    bool graphicsQueue = false;
+    VkCommandPool commandPool = nullptr;
+    StagingRing staging;
+
+    Batch recording;
+    std::vector<Batch> inFlight;
+    UploadTicket lastSubmitted = 0;
+    UploadTicket lastCompleted = 0;
+};
+
+} // namespace VaryZulu::Gfx
@@ -15,7 +15,7 @@ std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescription
     std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{
         VkVertexInputAttributeDescription{.location = 0,
             .binding = 0,
-            .format = VK_FORMAT_R32G32_SFLOAT,
+            .format = VK_FORMAT_R32G32B32_SFLOAT,
             .offset = offsetof(Vertex, pos)},
         VkVertexInputAttributeDescription{.location = 1,
             .binding = 0,
@@ -28,4 +28,31 @@ std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescription
 
     return attributeDescriptions;
 }
+
+VkVertexInputBindingDescription InstanceData::getBindingDescription()
+{
+    VkVertexInputBindingDescription bindingDescription{.binding = 1,
+        .stride = sizeof(InstanceData),
+        .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE};
+
+    return bindingDescription;
+}
+
+std::array<VkVertexInputAttributeDescription, 5> InstanceData::getAttributeDescriptions()
+{
+    std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+    for (uint32_t column = 0; column < 4; ++column) {
+        attributeDescriptions[column] = VkVertexInputAttributeDescription{.location = 3 + column,
+            .binding = 1,
+            .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+            .offset = static_cast<uint32_t>(offsetof(InstanceData, model) +
+                                            sizeof(glm::vec4) * column)};
+    }
+    attributeDescriptions[4] = VkVertexInputAttributeDescription{.location = 7,
+        .binding = 1,
+        .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+        .offset = offsetof(InstanceData, color)};
+
+    return attributeDescriptions;
+}
 } // namespace VaryZulu::Gfx
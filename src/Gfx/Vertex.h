@@ -6,17 +6,16 @@
 
 namespace VaryZulu::Gfx
 {
+// Per-frame camera. Per-object transforms come from the instance data
 struct UniformBufferObject
 {
-    alignas(16) glm::mat4 model;
-
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
 };
 
 struct Vertex
 {
-    glm::vec2 pos;
+    glm::vec3 pos;
     glm::vec3 color;
     glm::vec2 texCoord;
 
@@ -24,4 +23,15 @@ struct Vertex
     static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions();
 };
 
+// Per-instance attributes, fed through vertex binding 1 at instance rate
+struct InstanceData
+{
+    glm::mat4 model{1.0f};
+    glm::vec4 color{1.0f};
+
+    static VkVertexInputBindingDescription getBindingDescription();
+    // The model matrix takes one location per column
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions();
+};
+
 } // namespace VaryZulu::Gfx
@@ -1,19 +1,20 @@
+#include "Gfx/Config.h"
 #include "Gfx/Renderer.h"
 #include "Utils/Utils.h"
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
-int main()
+int main(int argc, char** argv)
 {
     spdlog::set_default_logger(
         spdlog::stdout_color_mt(std::string("logger"), spdlog::color_mode::always));
     spdlog::set_level(spdlog::level::debug);
 
     spdlog::info("Hello!");
-    VaryZulu::Gfx::Renderer app;
 
     try {
+        VaryZulu::Gfx::Renderer app(VaryZulu::Gfx::parseCommandLine(argc, argv));
         app.run();
     } catch (const std::exception& e) {
         spdlog::error("{}", e.what());
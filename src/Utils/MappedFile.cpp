@@ -0,0 +1,131 @@
+#include "MappedFile.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VaryZulu::Utils
+{
+#ifdef WIN32
+MappedFile::MappedFile(const std::string& path)
+{
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    LARGE_INTEGER size{};
+    void* view = nullptr;
+    // Empty files can't be mapped
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // The view keeps its own reference to the mapping
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    if (view) {
+        data = {static_cast<const std::byte*>(view), static_cast<size_t>(size.QuadPart)};
+        mapped = true;
+        return;
+    }
+    readBuffered(path);
+}
+
+void MappedFile::unmap()
+{
+    if (mapped) {
+        UnmapViewOfFile(data.data());
+    }
+}
+#else
+MappedFile::MappedFile(const std::string& path)
+{
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    struct stat info{};
+    void* view = MAP_FAILED;
+    size_t size = 0;
+    // Empty files can't be mapped, and procfs files claim to be empty while they are not
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        size = static_cast<size_t>(info.st_size);
+        view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (view != MAP_FAILED) {
+        data = {static_cast<const std::byte*>(view), size};
+        mapped = true;
+        return;
+    }
+    readBuffered(path);
+}
+
+void MappedFile::unmap()
+{
+    if (mapped) {
+        munmap(const_cast<std::byte*>(data.data()), data.size());
+    }
+}
+#endif
+
+void MappedFile::readBuffered(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    // The size isn't known up front for everything that ends up here, so read to the end
+    constexpr size_t chunkSize = 64 * 1024;
+    while (file) {
+        auto offset = buffer.size();
+        buffer.resize(offset + chunkSize);
+        file.read(reinterpret_cast<char*>(buffer.data() + offset),
+            static_cast<std::streamsize>(chunkSize));
+        buffer.resize(offset + static_cast<size_t>(file.gcount()));
+    }
+    if (file.bad()) {
+        throw std::runtime_error("Failed to read " + path);
+    }
+    data = buffer;
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(std::exchange(other.data, {}))
+    , buffer(std::move(other.buffer))
+    , mapped(std::exchange(other.mapped, false))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        data = std::exchange(other.data, {});
+        buffer = std::move(other.buffer);
+        mapped = std::exchange(other.mapped, false);
+    }
+    return *this;
+}
+
+} // namespace VaryZulu::Utils
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace VaryZulu::Utils
+{
+// Read-only contents of a whole file. Regular files are mapped, so pages are read in by the OS
+// on first access and never copied. Files that can't be mapped, like pipes, procfs entries or
+// some network filesystems, are read into a buffer instead
+class MappedFile
+{
+public:
+    // Throws if the file can't be opened or read
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Page aligned when mapped and aligned for any scalar type when buffered
+    std::span<const std::byte> getData() const
+    {
+        return data;
+    }
+
+    bool isMapped() const
+    {
+        return mapped;
+    }
+
+private:
+    void readBuffered(const std::string& path);
+    void unmap();
+
+    std::span<const std::byte> data;
+    std::vector<std::byte> buffer;
+    bool mapped = false;
+};
+} // namespace VaryZulu::Utils
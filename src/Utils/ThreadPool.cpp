@@ -0,0 +1,96 @@
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <utility>
+
+namespace VaryZulu::Utils
+{
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wakeCond.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::dispatch(const std::function<void(size_t)>& job)
+{
+    std::unique_lock lock(mutex);
+    currentJob = &job;
+    remaining = workers.size();
+    error = nullptr;
+    ++generation;
+    wakeCond.notify_all();
+    doneCond.wait(lock, [this] { return remaining == 0; });
+    currentJob = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wakeCond.notify_one();
+}
+
+void ThreadPool::workerLoop(size_t idx)
+{
+    VZ_TRACE_THREAD_NAME("Worker");
+    uint64_t seenGeneration = 0;
+    while (true) {
+        const std::function<void(size_t)>* job = nullptr;
+        std::function<void()> task;
+        {
+            std::unique_lock lock(mutex);
+            wakeCond.wait(lock,
+                [&] { return stopping || generation != seenGeneration || !tasks.empty(); });
+            if (stopping) {
+                return;
+            }
+            // A dispatch goes first, it blocks its caller until every worker took part
+            if (generation != seenGeneration) {
+                seenGeneration = generation;
+                job = currentJob;
+            } else {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+        }
+        if (task) {
+            task();
+            continue;
+        }
+        std::exception_ptr jobError;
+        try {
+            (*job)(idx);
+        } catch (...) {
+            jobError = std::current_exception();
+        }
+        {
+            std::lock_guard lock(mutex);
+            if (jobError && !error) {
+                error = jobError;
+            }
+            if (--remaining == 0) {
+                doneCond.notify_one();
+            }
+        }
+    }
+}
+
+} // namespace VaryZulu::Utils
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace VaryZulu::Utils
+{
+// Fixed set of worker threads. dispatch() runs a job once on every worker, passing the worker
+// index, and returns when all of them are done. Indices are stable, so workers can own
+// per-thread resources. enqueue() hands a task to whichever worker is free and returns at
+// once. A dispatch waits for running tasks, so latency-sensitive work gets its own pool.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t getThreadCount() const
+    {
+        return workers.size();
+    }
+
+    void dispatch(const std::function<void(size_t)>& job);
+    // Tasks still queued when the pool is destroyed are dropped. Tasks must not throw
+    void enqueue(std::function<void()> task);
+
+private:
+    void workerLoop(size_t idx);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeCond;
+    std::condition_variable doneCond;
+    const std::function<void(size_t)>* currentJob = nullptr;
+    std::deque<std::function<void()>> tasks;
+    uint64_t generation = 0;
+    size_t remaining = 0;
+    std::exception_ptr error;
+    bool stopping = false;
+};
+
+} // namespace VaryZulu::Utils
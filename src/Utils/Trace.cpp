@@ -0,0 +1,268 @@
+#include "Trace.h"
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace VaryZulu::Utils::Trace
+{
+namespace
+{
+struct Event
+{
+    const char* name = nullptr;
+    int64_t startNs = 0;
+    int64_t durationNs = 0;
+};
+
+// Filled by one thread only. Once next is set the owner never touches the chunk again, so the
+// flushing thread may free it
+struct Chunk
+{
+    static constexpr size_t CAPACITY = 4096;
+
+    std::array<Event, CAPACITY> events;
+    std::atomic<size_t> count{0};
+    std::atomic<Chunk*> next{nullptr};
+};
+
+struct ThreadBuffer
+{
+    uint32_t tid = 0;
+    const char* name = nullptr;
+    // Written by the owning thread only
+    Chunk* tail = nullptr;
+    // Read by the flushing thread only, under the registry mutex
+    Chunk* head = nullptr;
+    size_t flushed = 0;
+};
+
+struct Registry
+{
+    ~Registry()
+    {
+        for (auto& buffer : buffers) {
+            for (auto* chunk = buffer->head; chunk;) {
+                auto* next = chunk->next.load(std::memory_order_acquire);
+                delete chunk;
+                chunk = next;
+            }
+        }
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    JsonWriter writer;
+    bool exitHandlerInstalled = false;
+    std::atomic<bool> recording{false};
+};
+
+Registry& getRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+thread_local ThreadBuffer* threadBuffer = nullptr;
+
+ThreadBuffer& getThreadBuffer()
+{
+    if (!threadBuffer) {
+        auto& registry = getRegistry();
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->head = buffer->tail = new Chunk;
+        std::lock_guard lock(registry.mutex);
+        buffer->tid = static_cast<uint32_t>(registry.buffers.size());
+        threadBuffer = buffer.get();
+        registry.buffers.push_back(std::move(buffer));
+    }
+    return *threadBuffer;
+}
+
+const auto origin = std::chrono::steady_clock::now();
+
+void flushLocked(Registry& registry)
+{
+    for (auto& buffer : registry.buffers) {
+        auto* chunk = buffer->head;
+        while (true) {
+            // A set next pointer means the chunk is full, so it is read before the count
+            auto* next = chunk->next.load(std::memory_order_acquire);
+            auto count = chunk->count.load(std::memory_order_acquire);
+            for (auto i = buffer->flushed; i < count; ++i) {
+                const auto& event = chunk->events[i];
+                registry.writer.writeEvent(
+                    event.name, 0, buffer->tid, event.startNs, event.durationNs);
+            }
+            buffer->flushed = count;
+            if (!next) {
+                break;
+            }
+            delete chunk;
+            chunk = next;
+            buffer->flushed = 0;
+        }
+        buffer->head = chunk;
+    }
+    registry.writer.flush();
+}
+} // namespace
+
+bool JsonWriter::open(const std::string& path)
+{
+    file.open(path, std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    firstEvent = true;
+    return true;
+}
+
+void JsonWriter::writeEvent(
+    const char* name, uint32_t pid, uint32_t tid, int64_t startNs, int64_t durationNs)
+{
+    beginEvent();
+    file << "{\"name\":";
+    writeString(name);
+    file << R"(,"ph":"X","pid":)" << pid << ",\"tid\":" << tid
+         << ",\"ts\":" << static_cast<double>(startNs) / 1000.0
+         << ",\"dur\":" << static_cast<double>(durationNs) / 1000.0 << '}';
+}
+
+void JsonWriter::writeThreadName(uint32_t pid, uint32_t tid, const char* name)
+{
+    beginEvent();
+    file << R"({"name":"thread_name","ph":"M","pid":)" << pid << ",\"tid\":" << tid
+         << ",\"args\":{\"name\":";
+    writeString(name);
+    file << "}}";
+}
+
+void JsonWriter::flush()
+{
+    file.flush();
+}
+
+void JsonWriter::close()
+{
+    file << "\n]}\n";
+    file.close();
+}
+
+void JsonWriter::beginEvent()
+{
+    if (!firstEvent) {
+        file << ",\n";
+    }
+    firstEvent = false;
+}
+
+void JsonWriter::writeString(const char* value)
+{
+    file << '"';
+    for (auto* c = value; *c; ++c) {
+        auto ch = static_cast<unsigned char>(*c);
+        if (ch == '"' || ch == '\\') {
+            file << '\\' << *c;
+        } else if (ch < 0x20) {
+            file << "\\u" << std::hex << std::setw(4) << std::setfill('0') << unsigned{ch}
+                 << std::dec << std::setfill(' ');
+        } else {
+            file << *c;
+        }
+    }
+    file << '"';
+}
+
+void start(const std::string& path)
+{
+#ifndef VZ_ENABLE_TRACING
+    spdlog::warn("Tracing to {} requested, but scope markers were compiled out. "
+                 "Configure with -DENABLE_TRACING=ON",
+        path);
+#endif
+    auto& registry = getRegistry();
+    std::lock_guard lock(registry.mutex);
+    if (registry.writer.isOpen()) {
+        return;
+    }
+    if (!registry.writer.open(path)) {
+        spdlog::error("Failed to open trace file {}", path);
+        return;
+    }
+    registry.recording.store(true, std::memory_order_relaxed);
+    if (!registry.exitHandlerInstalled) {
+        // The registry was constructed before the handler is installed, so it outlives it
+        std::atexit(stop);
+        registry.exitHandlerInstalled = true;
+    }
+    spdlog::info("Tracing to {}", path);
+}
+
+void flush()
+{
+    auto& registry = getRegistry();
+    std::lock_guard lock(registry.mutex);
+    if (registry.writer.isOpen()) {
+        flushLocked(registry);
+    }
+}
+
+void stop()
+{
+    auto& registry = getRegistry();
+    std::lock_guard lock(registry.mutex);
+    if (!registry.writer.isOpen()) {
+        return;
+    }
+    registry.recording.store(false, std::memory_order_relaxed);
+    flushLocked(registry);
+    for (const auto& buffer : registry.buffers) {
+        if (buffer->name) {
+            registry.writer.writeThreadName(0, buffer->tid, buffer->name);
+        }
+    }
+    registry.writer.close();
+}
+
+void setThreadName(const char* name)
+{
+    auto& buffer = getThreadBuffer();
+    std::lock_guard lock(getRegistry().mutex);
+    buffer.name = name;
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - origin)
+        .count();
+}
+
+void record(const char* name, int64_t startNs, int64_t endNs)
+{
+    if (!getRegistry().recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+    auto& buffer = getThreadBuffer();
+    auto* chunk = buffer.tail;
+    auto count = chunk->count.load(std::memory_order_relaxed);
+    if (count == Chunk::CAPACITY) {
+        auto* fresh = new Chunk;
+        chunk->next.store(fresh, std::memory_order_release);
+        buffer.tail = chunk = fresh;
+        count = 0;
+    }
+    chunk->events[count] = Event{.name = name, .startNs = startNs, .durationNs = endNs - startNs};
+    chunk->count.store(count + 1, std::memory_order_release);
+}
+
+} // namespace VaryZulu::Utils::Trace
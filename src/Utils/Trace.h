@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Scope markers for the Chrome trace / Perfetto JSON format. Every thread appends to its own
+// buffer without locking. Without VZ_ENABLE_TRACING (CMake option ENABLE_TRACING) the markers
+// expand to nothing.
+namespace VaryZulu::Utils::Trace
+{
+// Opens the output file and starts recording. The trace is finished at exit if stop() is
+// never called
+void start(const std::string& path);
+// Writes everything recorded so far and releases the buffers it was held in
+void flush();
+// Flushes and closes the file
+void stop();
+
+// Called on the thread being named. The name has to be a string literal
+void setThreadName(const char* name);
+int64_t nowNs();
+// name has to be a string literal, only the pointer is stored
+void record(const char* name, int64_t startNs, int64_t endNs);
+
+// Writes events in the Chrome trace JSON format. Shared by the trace and the profiler dump,
+// which both take their timestamps from nowNs() so their files line up when viewed together
+class JsonWriter
+{
+public:
+    // Truncates the file. Returns false if it couldn't be opened
+    bool open(const std::string& path);
+    bool isOpen() const
+    {
+        return file.is_open();
+    }
+    void writeEvent(const char* name, uint32_t pid, uint32_t tid, int64_t startNs,
+        int64_t durationNs);
+    void writeThreadName(uint32_t pid, uint32_t tid, const char* name);
+    void flush();
+    // Terminates the JSON and closes the file
+    void close();
+
+private:
+    void beginEvent();
+    void writeString(const char* value);
+
+    std::ofstream file;
+    bool firstEvent = true;
+};
+
+class ScopedEvent
+{
+public:
+    explicit ScopedEvent(const char* eventName) : name(eventName), startNs(nowNs())
+    {
+    }
+    ~ScopedEvent()
+    {
+        record(name, startNs, nowNs());
+    }
+    ScopedEvent(const ScopedEvent&) = delete;
+    ScopedEvent& operator=(const ScopedEvent&) = delete;
+
+private:
+    const char* name;
+    int64_t startNs;
+};
+} // namespace VaryZulu::Utils::Trace
+
+#ifdef VZ_ENABLE_TRACING
+#define VZ_TRACE_CONCAT_INNER(a, b) a##b
+#define VZ_TRACE_CONCAT(a, b) VZ_TRACE_CONCAT_INNER(a, b)
+#define VZ_TRACE_SCOPE(name)                                                                       \
+    ::VaryZulu::Utils::Trace::ScopedEvent VZ_TRACE_CONCAT(vzTraceScope, __LINE__)(name)
+#define VZ_TRACE_THREAD_NAME(name) ::VaryZulu::Utils::Trace::setThreadName(name)
+#else
+#define VZ_TRACE_SCOPE(name)
+#define VZ_TRACE_THREAD_NAME(name)
+#endif
@@ -1,24 +1,12 @@
 #include "Utils.h"
 
-#include <fstream>
 #include <chrono>
 
 namespace VaryZulu::Utils
 {
-std::vector<char> readFile(const std::string& fileName)
+MappedFile readFile(const std::string& fileName)
 {
-    std::ifstream file(fileName, std::ios::ate | std::ios::binary);
-
-    if (!file.is_open()) {
-        throw std::runtime_error("failed to open file!");
-    }
-
-    size_t fileSize = static_cast<size_t>(file.tellg());
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
-    return buffer;
+    return MappedFile(fileName);
 }
 
 int64_t GetCurrentTimeMs()
@@ -1,10 +1,13 @@
 #pragma once
 
-#include <vector>
+#include "MappedFile.h"
+
+#include <cstdint>
 #include <string>
 
 namespace VaryZulu::Utils
 {
-std::vector<char> readFile(const std::string& fileName);
+// Maps the file instead of copying it, see MappedFile
+MappedFile readFile(const std::string& fileName);
 int64_t GetCurrentTimeMs();
 } // namespace VaryZulu::Utils
@@ -0,0 +1,291 @@
+#include "Assets/PackFormat.h"
+#include "Gfx/MeshRegistry.h"
+#include "Gfx/TextureContainer.h"
+#include "Gfx/TextureFormats.h"
+#include "Gfx/Vertex.h"
+#include "Utils/Utils.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Converts source assets into the pack the renderer maps with --asset-pack, see
+// Assets/PackFormat.h. Textures get their mip chain and shaders are checked here, so loading
+// them at runtime is a plain copy to the staging ring.
+//
+//   AssetBaker -o <pack> [-C <dir>] <asset>...
+//
+// Assets are read from the -C directory, the current one by default, and named by their path
+// relative to it. Baking from the renderer's run directory gives the names it loads.
+namespace
+{
+using namespace VaryZulu;
+
+struct BakedAsset
+{
+    std::string name;
+    Assets::PackEntry entry;
+    std::vector<char> data;
+};
+
+uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+template <typename T>
+void append(std::vector<char>& data, const T* values, size_t count)
+{
+    auto bytes = reinterpret_cast<const char*>(values);
+    data.insert(data.end(), bytes, bytes + sizeof(T) * count);
+}
+
+BakedAsset bakeTexture(std::span<const std::byte> file)
+{
+    BakedAsset asset{.entry{.type = Assets::AssetType::Texture}};
+    if (auto container = Gfx::parseTextureContainer(file)) {
+        asset.entry.info = {static_cast<uint32_t>(container->format), container->width,
+            container->height, container->mipLevels};
+        append(asset.data, container->levels.data(), container->levels.size());
+        return asset;
+    }
+
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    auto* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file.data()),
+        static_cast<int>(file.size()), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error(std::string{"Failed to decode image: "} + stbi_failure_reason());
+    }
+    auto mipLevels =
+        Gfx::getMipLevelCount(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+    auto chain = Gfx::buildMipChain(
+        pixels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), mipLevels);
+    stbi_image_free(pixels);
+    asset.entry.info = {static_cast<uint32_t>(VK_FORMAT_R8G8B8A8_SRGB),
+        static_cast<uint32_t>(width), static_cast<uint32_t>(height), mipLevels};
+    append(asset.data, chain.data(), chain.size());
+    return asset;
+}
+
+// Resolves one corner of an OBJ face, "p", "p/t", "p//n" or "p/t/n", to a vertex index.
+// Corners sharing position and texture coordinate share a vertex
+uint32_t getObjVertex(const std::string& corner, const std::vector<glm::vec3>& positions,
+    const std::vector<glm::vec2>& texCoords,
+    std::map<std::pair<size_t, size_t>, uint32_t>& vertexIds, Gfx::MeshData& mesh)
+{
+    // OBJ indices start at 1, negative ones count back from the last element so far
+    auto resolve = [](const std::string& text, size_t count) {
+        auto idx = std::stoll(text);
+        auto resolved = idx < 0 ? static_cast<long long>(count) + idx : idx - 1;
+        if (resolved < 0 || resolved >= static_cast<long long>(count)) {
+            throw std::runtime_error("OBJ face refers to a missing element");
+        }
+        return static_cast<size_t>(resolved);
+    };
+    auto slash = corner.find('/');
+    auto position = resolve(corner.substr(0, slash), positions.size());
+    auto texCoord = texCoords.size();
+    if (slash != std::string::npos) {
+        auto texText = corner.substr(slash + 1, corner.find('/', slash + 1) - slash - 1);
+        if (!texText.empty()) {
+            texCoord = resolve(texText, texCoords.size());
+        }
+    }
+    auto [found, added] = vertexIds.try_emplace(
+        std::pair{position, texCoord}, static_cast<uint32_t>(mesh.vertices.size()));
+    if (added) {
+        // OBJ puts the texture origin at the bottom, Vulkan samples from the top
+        auto uv = texCoord < texCoords.size() ? texCoords[texCoord] : glm::vec2{0.0f};
+        mesh.vertices.push_back(Gfx::Vertex{.pos = positions[position],
+            .color{1.0f, 1.0f, 1.0f},
+            .texCoord{uv.x, 1.0f - uv.y}});
+    }
+    return found->second;
+}
+
+BakedAsset bakeMesh(std::span<const std::byte> file)
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::map<std::pair<size_t, size_t>, uint32_t> vertexIds;
+    Gfx::MeshData mesh;
+    std::istringstream stream{
+        std::string{reinterpret_cast<const char*>(file.data()), file.size()}};
+    std::string line;
+    while (std::getline(stream, line)) {
+        std::istringstream words{line};
+        std::string tag;
+        words >> tag;
+        if (tag == "v") {
+            glm::vec3 position{0.0f};
+            words >> position.x >> position.y >> position.z;
+            positions.push_back(position);
+        } else if (tag == "vt") {
+            glm::vec2 texCoord{0.0f};
+            words >> texCoord.x >> texCoord.y;
+            texCoords.push_back(texCoord);
+        } else if (tag == "f") {
+            std::vector<uint32_t> face;
+            std::string corner;
+            while (words >> corner) {
+                face.push_back(getObjVertex(corner, positions, texCoords, vertexIds, mesh));
+            }
+            if (face.size() < 3) {
+                throw std::runtime_error("OBJ face with fewer than 3 corners");
+            }
+            // Polygons are assumed convex and split into a fan
+            for (size_t i = 1; i + 1 < face.size(); ++i) {
+                mesh.indices.insert(mesh.indices.end(), {face[0], face[i], face[i + 1]});
+            }
+        }
+    }
+    if (mesh.indices.empty()) {
+        throw std::runtime_error("OBJ file has no faces");
+    }
+
+    BakedAsset asset{.entry{.type = Assets::AssetType::Mesh}};
+    asset.entry.info = {static_cast<uint32_t>(mesh.vertices.size()),
+        static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(sizeof(Gfx::Vertex)),
+        0};
+    append(asset.data, mesh.vertices.data(), mesh.vertices.size());
+    append(asset.data, mesh.indices.data(), mesh.indices.size());
+    return asset;
+}
+
+BakedAsset bakeShader(std::span<const std::byte> file)
+{
+    constexpr uint32_t spirvMagic = 0x07230203;
+    uint32_t magic = 0;
+    if (file.size() >= sizeof(magic)) {
+        memcpy(&magic, file.data(), sizeof(magic));
+    }
+    if (file.size() % sizeof(uint32_t) != 0 || magic != spirvMagic) {
+        throw std::runtime_error("Not a SPIR-V module");
+    }
+    BakedAsset asset{.entry{.type = Assets::AssetType::Shader}};
+    append(asset.data, file.data(), file.size());
+    return asset;
+}
+
+BakedAsset bake(const std::filesystem::path& root, const std::string& name)
+{
+    auto extension = std::filesystem::path{name}.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+        [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    auto mapped = Utils::readFile((root / name).string());
+    auto file = mapped.getData();
+    BakedAsset asset;
+    if (extension == ".spv") {
+        asset = bakeShader(file);
+    } else if (extension == ".obj") {
+        asset = bakeMesh(file);
+    } else if (extension == ".ktx2" || extension == ".dds" || extension == ".png" ||
+               extension == ".jpg" || extension == ".jpeg" || extension == ".tga" ||
+               extension == ".bmp") {
+        asset = bakeTexture(file);
+    } else {
+        throw std::runtime_error("Don't know how to bake " + name);
+    }
+    asset.name = std::filesystem::path{name}.lexically_normal().generic_string();
+    if (asset.name.size() >= Assets::PACK_MAX_NAME) {
+        throw std::runtime_error("Asset name too long: " + asset.name);
+    }
+    memcpy(asset.entry.name.data(), asset.name.data(), asset.name.size());
+    asset.entry.size = asset.data.size();
+    return asset;
+}
+
+void writePack(const std::string& path, std::vector<BakedAsset>& assets)
+{
+    // The runtime finds assets by binary search over the names
+    std::sort(assets.begin(), assets.end(),
+        [](const BakedAsset& a, const BakedAsset& b) { return a.name < b.name; });
+    auto duplicate = std::adjacent_find(assets.begin(), assets.end(),
+        [](const BakedAsset& a, const BakedAsset& b) { return a.name == b.name; });
+    if (duplicate != assets.end()) {
+        throw std::runtime_error("Asset given twice: " + duplicate->name);
+    }
+
+    Assets::PackHeader header{.entryCount = static_cast<uint32_t>(assets.size()),
+        .entrySize = sizeof(Assets::PackEntry),
+        .tocOffset = sizeof(Assets::PackHeader)};
+    auto offset = alignUp(header.tocOffset + sizeof(Assets::PackEntry) * assets.size(),
+        Assets::PACK_ALIGNMENT);
+    for (auto& asset : assets) {
+        asset.entry.offset = offset;
+        offset = alignUp(offset + asset.entry.size, Assets::PACK_ALIGNMENT);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& asset : assets) {
+        out.write(reinterpret_cast<const char*>(&asset.entry), sizeof(asset.entry));
+    }
+    for (const auto& asset : assets) {
+        std::vector<char> padding(asset.entry.offset - static_cast<uint64_t>(out.tellp()));
+        out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+        out.write(asset.data.data(), static_cast<std::streamsize>(asset.data.size()));
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+    spdlog::info("Wrote {} assets to {}, {} KiB", assets.size(), path, offset / 1024);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try {
+        std::string output;
+        std::filesystem::path root = ".";
+        std::vector<std::string> names;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg{argv[i]};
+            if (arg == "-o" && i + 1 < argc) {
+                output = argv[++i];
+            } else if (arg == "-C" && i + 1 < argc) {
+                root = argv[++i];
+            } else {
+                names.push_back(arg);
+            }
+        }
+        if (output.empty() || names.empty()) {
+            spdlog::error("Usage: AssetBaker -o <pack> [-C <dir>] <asset>...");
+            return EXIT_FAILURE;
+        }
+
+        std::vector<BakedAsset> assets;
+        for (const auto& name : names) {
+            try {
+                assets.push_back(bake(root, name));
+            } catch (const std::exception& e) {
+                spdlog::error("{}: {}", name, e.what());
+                throw std::runtime_error("Baking failed");
+            }
+            spdlog::info("Baked {}, {} bytes", assets.back().name, assets.back().data.size());
+        }
+        writePack(output, assets);
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}